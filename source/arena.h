@@ -0,0 +1,162 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <cstddef>
+#include <cstdlib>
+#include <vector>
+
+#include <memorytracker.h>
+
+// allocation counters, upstream calls are the ones that actually reached malloc
+struct AllocStats {
+    size_t allocs = 0;
+    size_t upstreamAllocs = 0;
+    size_t upstreamBytes = 0;
+    size_t peakBytes = 0;
+};
+
+// bump allocator for the scratch memory of a single job (e.g. one chunk).
+// allocations are only released all at once by reset(), which keeps the blocks
+// around so a warmed up arena never calls malloc again
+class Arena {
+private:
+    std::vector<char*> blocks;
+    std::vector<size_t> blockSizes;
+    size_t blockSize;
+    // block currently bumped and the offset into it
+    size_t current = 0;
+    size_t offset = 0;
+    size_t used = 0;
+    AllocStats stats;
+    MemoryTag tag;
+
+public:
+    // @param tag what the blocks are accounted to in the MemoryTracker
+    Arena(size_t blockSize = 64 * 1024, MemoryTag tag = mem_terrain):blockSize(blockSize), tag(tag) {}
+
+    ~Arena() {
+        for (size_t i = 0; i < blocks.size(); i++) {
+            free(blocks[i]);
+        }
+        MemoryTracker::instance().remove(tag, stats.upstreamBytes);
+    }
+
+    Arena(const Arena&) = delete;
+    Arena &operator=(const Arena&) = delete;
+
+    // returns uninitialized memory that stays valid until the next reset()
+    void *alloc(size_t bytes, size_t align = alignof(std::max_align_t)) {
+        ++stats.allocs;
+        while (current < blocks.size()) {
+            size_t start = (offset + align - 1) & ~(align - 1);
+            if (start + bytes <= blockSizes[current]) {
+                offset = start + bytes;
+                used += bytes;
+                if (used > stats.peakBytes) {
+                    stats.peakBytes = used;
+                }
+                return blocks[current] + start;
+            }
+            // the rest of this block is wasted until the next reset
+            ++current;
+            offset = 0;
+        }
+        // no block left that fits, blocks are malloc aligned so offset 0 is always aligned
+        size_t size = bytes > blockSize ? bytes : blockSize;
+        blocks.push_back((char*)malloc(size));
+        blockSizes.push_back(size);
+        ++stats.upstreamAllocs;
+        stats.upstreamBytes += size;
+        MemoryTracker::instance().add(tag, size);
+        current = blocks.size() - 1;
+        offset = bytes;
+        used += bytes;
+        if (used > stats.peakBytes) {
+            stats.peakBytes = used;
+        }
+        return blocks[current];
+    }
+
+    // returns uninitialized storage for count objects of trivial type T
+    template <typename T>
+    T *alloc(size_t count) {
+        return (T*)alloc(count * sizeof(T), alignof(T));
+    }
+
+    // releases everything allocated since the last reset
+    void reset() {
+        current = 0;
+        offset = 0;
+        used = 0;
+    }
+
+    // returns the bytes handed out since the last reset
+    size_t bytesUsed() {
+        return used;
+    }
+
+    const AllocStats &getStats() {
+        return stats;
+    }
+};
+
+// pool of fixed-size buffers (e.g. the blocks of a chunk), buffers released when
+// their chunk is evicted are handed out again before new ones are allocated
+template <typename T>
+class BufferPool {
+private:
+    size_t capacity;
+    std::vector<T*> buffers;
+    std::vector<T*> freeList;
+    AllocStats stats;
+
+public:
+    // @param capacity the number of elements of every buffer
+    BufferPool(size_t capacity):capacity(capacity) {}
+
+    ~BufferPool() {
+        for (size_t i = 0; i < buffers.size(); i++) {
+            delete[] buffers[i];
+        }
+    }
+
+    BufferPool(const BufferPool&) = delete;
+    BufferPool &operator=(const BufferPool&) = delete;
+
+    // returns a buffer of bufferCapacity() elements
+    T *acquire() {
+        ++stats.allocs;
+        if (!freeList.empty()) {
+            T *buffer = freeList.back();
+            freeList.pop_back();
+            return buffer;
+        }
+        buffers.push_back(new T[capacity]);
+        // keep the free list large enough that release() never allocates
+        freeList.reserve(buffers.capacity());
+        ++stats.upstreamAllocs;
+        stats.upstreamBytes += capacity * sizeof(T);
+        stats.peakBytes = stats.upstreamBytes;
+        return buffers.back();
+    }
+
+    // returns a buffer obtained from acquire() to the pool
+    void release(T *buffer) {
+        freeList.push_back(buffer);
+    }
+
+    size_t bufferCapacity() {
+        return capacity;
+    }
+
+    // returns the number of buffers currently handed out
+    size_t inUse() {
+        return buffers.size() - freeList.size();
+    }
+
+    const AllocStats &getStats() {
+        return stats;
+    }
+};
+
+#endif
@@ -0,0 +1,388 @@
+#include <benchmark/benchmark.h>
+
+#include <includes/PerlinNoise.hpp>
+#include <terraingen.h>
+#include <arena.h>
+#include <chunk.h>
+#include <rlechunk.h>
+#include <octree.h>
+#include <codec.h>
+#include <chunkcache.h>
+#include <world.h>
+#include <mesher.h>
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <vector>
+
+// micro-benchmarks of noise, generation, meshing and storage. run with
+// --benchmark_format=json or --benchmark_out=file.json to keep results between versions
+
+// every allocation of the process goes through here so benchmarks can report the bytes they allocate.
+// all the plain, array, sized and nothrow forms are replaced so each new meets a matching delete
+static std::atomic<size_t> bytesAllocated(0);
+
+static void *allocate(size_t size) noexcept {
+    bytesAllocated += size;
+    return std::malloc(size ? size : 1);
+}
+
+// kept out of line so gcc doesn't inline free() into a caller of delete and take the pointer
+// it got from new for a mismatched pair
+#ifdef __GNUC__
+__attribute__((noinline))
+#endif
+static void deallocate(void *p) noexcept {
+    std::free(p);
+}
+
+void *operator new(size_t size) {
+    void *p = allocate(size);
+    if (p == nullptr) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void *operator new[](size_t size) {
+    return operator new(size);
+}
+
+void *operator new(size_t size, const std::nothrow_t&) noexcept {
+    return allocate(size);
+}
+
+void *operator new[](size_t size, const std::nothrow_t&) noexcept {
+    return allocate(size);
+}
+
+void operator delete(void *p) noexcept {
+    deallocate(p);
+}
+
+void operator delete[](void *p) noexcept {
+    deallocate(p);
+}
+
+void operator delete(void *p, size_t) noexcept {
+    deallocate(p);
+}
+
+void operator delete[](void *p, size_t) noexcept {
+    deallocate(p);
+}
+
+void operator delete(void *p, const std::nothrow_t&) noexcept {
+    deallocate(p);
+}
+
+void operator delete[](void *p, const std::nothrow_t&) noexcept {
+    deallocate(p);
+}
+
+namespace {
+
+const int SEED = 12345;
+
+// reports samples/s, ns/sample and bytes allocated per iteration
+void report(benchmark::State &state, double samplesPerIteration, size_t bytesBefore) {
+    double samples = samplesPerIteration * state.iterations();
+    state.counters["samples/s"] = benchmark::Counter(samples, benchmark::Counter::kIsRate);
+    state.counters["ns/sample"] = benchmark::Counter(samples / 1e9, benchmark::Counter::kIsRate | benchmark::Counter::kInvert);
+    state.counters["bytes/iter"] = benchmark::Counter((double)(bytesAllocated - bytesBefore) / state.iterations());
+}
+
+void BM_Noise1D(benchmark::State &state) {
+    siv::PerlinNoise perlin(SEED);
+    double x = 0.0;
+    size_t before = bytesAllocated;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(perlin.noise(x));
+        x += 0.37;
+    }
+    report(state, 1, before);
+}
+BENCHMARK(BM_Noise1D);
+
+void BM_Noise2D(benchmark::State &state) {
+    siv::PerlinNoise perlin(SEED);
+    double x = 0.0;
+    size_t before = bytesAllocated;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(perlin.noise(x, x * 0.5));
+        x += 0.37;
+    }
+    report(state, 1, before);
+}
+BENCHMARK(BM_Noise2D);
+
+void BM_Noise3D(benchmark::State &state) {
+    siv::PerlinNoise perlin(SEED);
+    double x = 0.0;
+    size_t before = bytesAllocated;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(perlin.noise(x, x * 0.5, x * 0.25));
+        x += 0.37;
+    }
+    report(state, 1, before);
+}
+BENCHMARK(BM_Noise3D);
+
+// the 2D octave noise the terrain heights come from, by octave count
+void BM_OctaveNoise(benchmark::State &state) {
+    siv::PerlinNoise perlin(SEED);
+    int octaves = state.range(0);
+    double x = 0.0;
+    size_t before = bytesAllocated;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(perlin.octaveNoise0_1(x, x * 0.5, octaves));
+        x += 0.37;
+    }
+    report(state, 1, before);
+}
+BENCHMARK(BM_OctaveNoise)->Arg(1)->Arg(2)->Arg(4)->Arg(8)->Arg(16);
+
+// the full square of block coords around a camera, a sample is a column
+void BM_GenCoords(benchmark::State &state) {
+    Terrain terrain(state.range(0), SEED);
+    std::vector<glm::vec4> coords;
+    float x = 0.0f;
+    size_t before = bytesAllocated;
+    for (auto _ : state) {
+        terrain.genCoords(glm::vec3(x, 0.0f, 0.0f), coords);
+        benchmark::DoNotOptimize(coords.data());
+        x += 1.0f;
+    }
+    double columns = (double)(terrain.getWidth() + 1) * (terrain.getWidth() + 1);
+    report(state, columns, before);
+}
+BENCHMARK(BM_GenCoords)->Arg(50)->Arg(100)->Arg(200)->Arg(400)->Unit(benchmark::kMicrosecond);
+
+// a chunk into palette storage, a sample is a column
+void BM_GenChunk(benchmark::State &state) {
+    Terrain terrain(100, SEED);
+    Arena scratch;
+    Chunk chunk;
+    int cx = 0;
+    size_t before = bytesAllocated;
+    for (auto _ : state) {
+        terrain.genChunk(cx++, 0, scratch, chunk);
+        scratch.reset();
+        benchmark::DoNotOptimize(&chunk);
+    }
+    report(state, Chunk::SIZE * Chunk::SIZE, before);
+}
+BENCHMARK(BM_GenChunk)->Unit(benchmark::kMicrosecond);
+
+// a chunk into run-length columns, a sample is a column
+void BM_GenRleChunk(benchmark::State &state) {
+    Terrain terrain(100, SEED);
+    Arena scratch;
+    RleChunk chunk;
+    int cx = 0;
+    size_t before = bytesAllocated;
+    for (auto _ : state) {
+        terrain.genChunk(cx++, 0, scratch, chunk);
+        scratch.reset();
+        benchmark::DoNotOptimize(&chunk);
+    }
+    report(state, Chunk::SIZE * Chunk::SIZE, before);
+}
+BENCHMARK(BM_GenRleChunk)->Unit(benchmark::kMicrosecond);
+
+// generates a side x side square of chunks
+void genChunks(int side, std::vector<Chunk> &chunks) {
+    Terrain terrain(100, SEED);
+    Arena scratch;
+    chunks.resize(side * side);
+    for (int z = 0; z < side; z++) {
+        for (int x = 0; x < side; x++) {
+            terrain.genChunk(x, z, scratch, chunks[z * side + x]);
+            scratch.reset();
+        }
+    }
+}
+
+// the faces of a chunk the viewer draws with the chunks around it in the grid, a sample is a quad
+template <typename ChunkT>
+void meshChunks(benchmark::State &state, int side, const std::vector<ChunkT> &chunks) {
+    std::vector<Neighbourhood<ChunkT> > neighbourhoods;
+    for (int z = 0; z < side; z++) {
+        for (int x = 0; x < side; x++) {
+            Neighbourhood<ChunkT> around(chunks[z * side + x]);
+            for (int dz = -1; dz <= 1; dz++) {
+                for (int dx = -1; dx <= 1; dx++) {
+                    if (x + dx >= 0 && x + dx < side && z + dz >= 0 && z + dz < side) {
+                        around.chunks[dz + 1][dx + 1] = &chunks[(z + dz) * side + x + dx];
+                    }
+                }
+            }
+            neighbourhoods.push_back(around);
+        }
+    }
+    ChunkMeshData mesh;
+    size_t quads = 0;
+    size_t i = 0;
+    size_t before = bytesAllocated;
+    for (auto _ : state) {
+        ChunkMesher::build(neighbourhoods[i % neighbourhoods.size()], i % side, i / side % side, mesh);
+        benchmark::DoNotOptimize(mesh.vertices.data());
+        quads += mesh.vertices.size() / 4;
+        i++;
+    }
+    report(state, (double)quads / state.iterations(), before);
+}
+
+void BM_MeshChunk(benchmark::State &state) {
+    const int SIDE = 4;
+    std::vector<Chunk> chunks;
+    genChunks(SIDE, chunks);
+    meshChunks(state, SIDE, chunks);
+}
+BENCHMARK(BM_MeshChunk)->Unit(benchmark::kMicrosecond);
+
+// the same chunks meshed from their runs
+void BM_MeshRleChunk(benchmark::State &state) {
+    const int SIDE = 4;
+    std::vector<Chunk> chunks;
+    genChunks(SIDE, chunks);
+    std::vector<RleChunk> runs(chunks.size());
+    for (size_t i = 0; i < chunks.size(); i++) {
+        runs[i].fromChunk(chunks[i]);
+    }
+    meshChunks(state, SIDE, runs);
+}
+BENCHMARK(BM_MeshRleChunk)->Unit(benchmark::kMicrosecond);
+
+// point lookups in dense chunks against the octree of the same chunks
+void BM_DenseGet(benchmark::State &state) {
+    std::vector<Chunk> chunks;
+    genChunks(8, chunks);
+    unsigned int r = 1;
+    size_t before = bytesAllocated;
+    for (auto _ : state) {
+        r = r * 1103515245u + 12345u;
+        int x = r >> 8 & 127;
+        int z = r >> 16 & 127;
+        int y = r & 7;
+        benchmark::DoNotOptimize(chunks[(z / 16) * 8 + x / 16].get(x % 16, y, z % 16));
+    }
+    report(state, 1, before);
+}
+BENCHMARK(BM_DenseGet);
+
+void BM_OctreeGet(benchmark::State &state) {
+    std::vector<Chunk> chunks;
+    genChunks(8, chunks);
+    std::vector<const Chunk*> pointers;
+    for (size_t i = 0; i < chunks.size(); i++) {
+        pointers.push_back(&chunks[i]);
+    }
+    SparseVoxelOctree octree;
+    octree.build(pointers, 8, glm::ivec3(0));
+    state.counters["bytes"] = octree.memoryUsage();
+    unsigned int r = 1;
+    size_t before = bytesAllocated;
+    for (auto _ : state) {
+        r = r * 1103515245u + 12345u;
+        benchmark::DoNotOptimize(octree.get(r >> 8 & 127, r & 7, r >> 16 & 127));
+    }
+    report(state, 1, before);
+}
+BENCHMARK(BM_OctreeGet);
+
+// a sample is a chunk
+void BM_OctreeBuild(benchmark::State &state) {
+    std::vector<Chunk> chunks;
+    genChunks(8, chunks);
+    std::vector<const Chunk*> pointers;
+    for (size_t i = 0; i < chunks.size(); i++) {
+        pointers.push_back(&chunks[i]);
+    }
+    size_t before = bytesAllocated;
+    for (auto _ : state) {
+        SparseVoxelOctree octree;
+        octree.build(pointers, 8, glm::ivec3(0));
+        benchmark::DoNotOptimize(octree.nodeCount());
+    }
+    report(state, chunks.size(), before);
+}
+BENCHMARK(BM_OctreeBuild)->Unit(benchmark::kMicrosecond);
+
+// compresses serialized chunks with every codec of the build, a sample is a byte in
+void BM_Compress(benchmark::State &state) {
+    const Codec *codec = availableCodecs()[state.range(0)];
+    state.SetLabel(codec->name());
+    std::vector<Chunk> chunks;
+    genChunks(4, chunks);
+    std::vector<std::vector<unsigned char> > raw(chunks.size());
+    size_t rawBytes = 0;
+    size_t packedBytes = 0;
+    std::vector<unsigned char> packed;
+    for (size_t i = 0; i < chunks.size(); i++) {
+        chunks[i].serialize(raw[i]);
+        codec->compress(raw[i].data(), raw[i].size(), packed);
+        rawBytes += raw[i].size();
+        packedBytes += packed.size();
+    }
+    size_t i = 0;
+    size_t bytes = 0;
+    size_t before = bytesAllocated;
+    for (auto _ : state) {
+        const std::vector<unsigned char> &in = raw[i++ % raw.size()];
+        codec->compress(in.data(), in.size(), packed);
+        bytes += in.size();
+    }
+    state.SetBytesProcessed(bytes);
+    state.counters["ratio"] = (double)rawBytes / packedBytes;
+    report(state, (double)bytes / state.iterations(), before);
+}
+BENCHMARK(BM_Compress)->DenseRange(0, availableCodecs().size() - 1)->Unit(benchmark::kMicrosecond);
+
+// a sample is a byte out
+void BM_Decompress(benchmark::State &state) {
+    const Codec *codec = availableCodecs()[state.range(0)];
+    state.SetLabel(codec->name());
+    std::vector<Chunk> chunks;
+    genChunks(4, chunks);
+    std::vector<std::vector<unsigned char> > packed(chunks.size());
+    std::vector<size_t> rawSizes(chunks.size());
+    std::vector<unsigned char> raw;
+    for (size_t i = 0; i < chunks.size(); i++) {
+        raw.clear();
+        chunks[i].serialize(raw);
+        codec->compress(raw.data(), raw.size(), packed[i]);
+        rawSizes[i] = raw.size();
+    }
+    size_t i = 0;
+    size_t bytes = 0;
+    size_t before = bytesAllocated;
+    for (auto _ : state) {
+        size_t k = i++ % packed.size();
+        codec->decompress(packed[k].data(), packed[k].size(), raw, rawSizes[k]);
+        bytes += rawSizes[k];
+    }
+    state.SetBytesProcessed(bytes);
+    report(state, (double)bytes / state.iterations(), before);
+}
+BENCHMARK(BM_Decompress)->DenseRange(0, availableCodecs().size() - 1)->Unit(benchmark::kMicrosecond);
+
+// fetches a chunk the cache just evicted, 0 with no warm tier so it is generated again,
+// 1 with a warm tier so it is decompressed. a sample is a chunk
+void BM_CacheRefetch(benchmark::State &state) {
+    Terrain terrain(100, SEED);
+    ChunkCache cache(terrain, nullptr, 0, state.range(0) ? 1 << 20 : 0);
+    size_t before = bytesAllocated;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(cache.acquire(3, 5));
+        cache.release(3, 5);
+        cache.trim();
+    }
+    report(state, 1, before);
+}
+BENCHMARK(BM_CacheRefetch)->Arg(0)->Arg(1)->Unit(benchmark::kMicrosecond);
+
+}
+
+BENCHMARK_MAIN();
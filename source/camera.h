@@ -2,6 +2,7 @@
 #define CAMERA_H
 
 #include <includes/glm/glm.hpp>
+#include <includes/glm/gtc/matrix_transform.hpp>
 
 // enumeration of keyboard inputs
 enum keyboard_input {
@@ -21,6 +22,8 @@ private:
     float multiplier = 10.0f;
     float deltaTime = 0.0f;
     float lastFrame = 0.0f;
+    // incremented whenever the view changes, lets callers skip redundant work
+    unsigned int version = 0;
 public:
     Camera(glm::vec3 pos, glm::vec3 front, glm::vec3 up):pos(pos), front(front), up(up) {}
 
@@ -29,6 +32,11 @@ public:
         return pos;
     }
 
+    // returns the change counter of the camera view
+    unsigned int getVersion() {
+        return version;
+    }
+
     // returns the view matrix by the camera
     glm::mat4 getViewMatrix() {
         return glm::lookAt(pos, pos + front, up);
@@ -53,6 +61,9 @@ public:
         } else if (key == key_d) {
             pos += glm::normalize(glm::cross(front, up)) * speed;
         }
+        if (speed != 0.0f) {
+            ++version;
+        }
     }
 };
 
@@ -0,0 +1,372 @@
+#ifndef CHUNK_H
+#define CHUNK_H
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+// block types stored in chunks, air is what a new chunk is filled with. sections hold any
+// 16 bit id, but RleChunk packs ids into 7 bits, so block types have to stay below block_type_limit
+typedef std::uint16_t BlockId;
+
+enum block_type {
+    block_air = 0,
+    block_dirt = 1,
+    block_grass = 2,
+    block_type_limit = 128
+};
+
+// class to store a 16x16x16 cube of blocks as indices into a palette of the block types it
+// contains. indices are bit-packed with 1, 2, 4 or 8 bits per block depending on the size of
+// the palette (16 bits past 256 types), so an index never straddles two words.
+// a section made of a single block type stores no indices at all
+class ChunkSection {
+private:
+    // palette is empty while the section is uniform, the block type is then in uniform
+    BlockId uniform = block_air;
+    std::vector<BlockId> palette;
+    std::vector<std::uint64_t> data;
+    unsigned int bits = 0;
+
+    static unsigned int indexOf(int x, int y, int z) {
+        return (y * SIZE + z) * SIZE + x;
+    }
+
+    unsigned int readIndex(unsigned int i) const {
+        unsigned int bit = i * bits;
+        return (data[bit >> 6] >> (bit & 63)) & ((1u << bits) - 1);
+    }
+
+    void writeIndex(unsigned int i, unsigned int value) {
+        unsigned int bit = i * bits;
+        std::uint64_t mask = (std::uint64_t)((1u << bits) - 1) << (bit & 63);
+        std::uint64_t &word = data[bit >> 6];
+        word = (word & ~mask) | ((std::uint64_t)value << (bit & 63));
+    }
+
+    // re-packs the indices with enough bits for a palette of size entries. indices only ever
+    // grow, so they are widened in place from the back and the storage of the section is reused
+    void repack(unsigned int size) {
+        unsigned int newBits = 1;
+        while ((1u << newBits) < size) {
+            newBits *= 2;
+        }
+        if (newBits == bits) {
+            return;
+        }
+        unsigned int oldBits = bits;
+        data.resize(VOLUME * newBits / 64);
+        bits = newBits;
+        if (oldBits == 0) {
+            // every block of a uniform section refers to entry 0
+            std::fill(data.begin(), data.end(), 0);
+            return;
+        }
+        for (unsigned int i = VOLUME; i-- > 0;) {
+            unsigned int bit = i * oldBits;
+            unsigned int value = (data[bit >> 6] >> (bit & 63)) & ((1u << oldBits) - 1);
+            writeIndex(i, value);
+        }
+    }
+
+    // little endian integer helpers of the serialized form
+    static void putInt(std::vector<unsigned char> &out, std::uint64_t value, int bytes) {
+        for (int i = 0; i < bytes; i++) {
+            out.push_back((unsigned char)(value >> (8 * i)));
+        }
+    }
+
+    static std::uint64_t getInt(const unsigned char *in, int bytes) {
+        std::uint64_t value = 0;
+        for (int i = 0; i < bytes; i++) {
+            value |= (std::uint64_t)in[i] << (8 * i);
+        }
+        return value;
+    }
+
+public:
+    static const int SIZE = 16;
+    static const unsigned int VOLUME = SIZE * SIZE * SIZE;
+    // bytes of the largest serialized section, with a full palette and 16 bit indices
+    static const size_t MAX_SERIALIZED_SIZE = 3 + 0xffff * 2 + VOLUME * 2;
+
+    // returns the block type at the local coords
+    BlockId get(int x, int y, int z) const {
+        if (bits == 0) {
+            return uniform;
+        }
+        return palette[readIndex(indexOf(x, y, z))];
+    }
+
+    // sets the block type at the local coords, growing the palette if the type is new
+    void set(int x, int y, int z, BlockId id) {
+        if (bits == 0) {
+            if (id == uniform) {
+                return;
+            }
+            // leave the uniform representation, every block refers to entry 0
+            palette.push_back(uniform);
+            repack(2);
+        }
+        unsigned int entry = 0;
+        while (entry < palette.size() && palette[entry] != id) {
+            entry++;
+        }
+        if (entry == palette.size()) {
+            palette.push_back(id);
+            repack(palette.size());
+        }
+        writeIndex(indexOf(x, y, z), entry);
+    }
+
+    // sets every block of the section, which becomes uniform
+    void fill(BlockId id) {
+        uniform = id;
+        palette.clear();
+        data.clear();
+        bits = 0;
+    }
+
+    // drops palette entries no block refers to anymore and shrinks the indices,
+    // going back to the uniform representation if only one type is left.
+    // unlike fill() this also gives the storage back
+    void compact() {
+        if (bits == 0) {
+            std::vector<BlockId>().swap(palette);
+            std::vector<std::uint64_t>().swap(data);
+            return;
+        }
+        std::vector<unsigned int> remap(palette.size(), ~0u);
+        std::vector<BlockId> used;
+        for (unsigned int i = 0; i < VOLUME; i++) {
+            unsigned int entry = readIndex(i);
+            if (remap[entry] == ~0u) {
+                remap[entry] = used.size();
+                used.push_back(palette[entry]);
+            }
+        }
+        if (used.size() == 1) {
+            fill(used[0]);
+            compact();
+            return;
+        }
+        std::vector<unsigned int> indices(VOLUME);
+        for (unsigned int i = 0; i < VOLUME; i++) {
+            indices[i] = remap[readIndex(i)];
+        }
+        palette.swap(used);
+        data.clear();
+        bits = 0;
+        repack(palette.size());
+        for (unsigned int i = 0; i < VOLUME; i++) {
+            writeIndex(i, indices[i]);
+        }
+    }
+
+    bool isUniform() const {
+        return bits == 0;
+    }
+
+    // returns the block type of a uniform section
+    BlockId uniformId() const {
+        return uniform;
+    }
+
+    unsigned int bitsPerBlock() const {
+        return bits;
+    }
+
+    const std::vector<BlockId> &getPalette() const {
+        return palette;
+    }
+
+    const std::vector<std::uint64_t> &getData() const {
+        return data;
+    }
+
+    // appends the section to out as bits, palette size, palette and packed words, little endian
+    void serialize(std::vector<unsigned char> &out) const {
+        out.push_back(bits);
+        unsigned int size = bits == 0 ? 1 : palette.size();
+        putInt(out, size, 2);
+        for (unsigned int i = 0; i < size; i++) {
+            putInt(out, bits == 0 ? uniform : palette[i], 2);
+        }
+        for (size_t w = 0; w < data.size(); w++) {
+            putInt(out, data[w], 8);
+        }
+    }
+
+    // reads a section written by serialize, reusing the storage of the section
+    // @return the number of bytes read, 0 if in is too short or malformed
+    size_t deserialize(const unsigned char *in, size_t length) {
+        if (length < 3) {
+            return 0;
+        }
+        unsigned int newBits = in[0];
+        unsigned int size = (unsigned int)getInt(in + 1, 2);
+        if ((newBits != 0 && newBits != 1 && newBits != 2 && newBits != 4 && newBits != 8 && newBits != 16)
+                || size == 0 || (newBits != 0 && size > (1u << newBits))) {
+            return 0;
+        }
+        size_t words = VOLUME * newBits / 64;
+        size_t total = 3 + size * 2 + words * 8;
+        if (length < total) {
+            return 0;
+        }
+        const unsigned char *p = in + 3;
+        if (newBits == 0) {
+            fill((BlockId)getInt(p, 2));
+            return total;
+        }
+        // every index has to point into the palette, checked before the section is touched
+        if (size < (1u << newBits)) {
+            const unsigned char *packed = p + size * 2;
+            std::uint64_t mask = (1u << newBits) - 1;
+            for (size_t w = 0; w < words; w++) {
+                std::uint64_t word = getInt(packed + w * 8, 8);
+                for (unsigned int k = 0; k < 64 / newBits; k++, word >>= newBits) {
+                    if ((word & mask) >= size) {
+                        return 0;
+                    }
+                }
+            }
+        }
+        palette.resize(size);
+        for (unsigned int i = 0; i < size; i++, p += 2) {
+            palette[i] = (BlockId)getInt(p, 2);
+        }
+        data.resize(words);
+        for (size_t w = 0; w < words; w++, p += 8) {
+            data[w] = getInt(p, 8);
+        }
+        bits = newBits;
+        return total;
+    }
+
+    // calls fn(x, y, z, id) for every block in y, z, x order, decoding the packed
+    // words sequentially instead of locating every index
+    template <typename Fn>
+    void forEach(Fn fn) const {
+        if (bits == 0) {
+            for (int y = 0; y < SIZE; y++) {
+                for (int z = 0; z < SIZE; z++) {
+                    for (int x = 0; x < SIZE; x++) {
+                        fn(x, y, z, uniform);
+                    }
+                }
+            }
+            return;
+        }
+        unsigned int perWord = 64 / bits;
+        std::uint64_t mask = (1u << bits) - 1;
+        unsigned int i = 0;
+        for (size_t w = 0; w < data.size(); w++) {
+            std::uint64_t word = data[w];
+            for (unsigned int k = 0; k < perWord; k++, i++) {
+                fn(i % SIZE, i / (SIZE * SIZE), (i / SIZE) % SIZE, palette[word & mask]);
+                word >>= bits;
+            }
+        }
+    }
+
+    // returns the bytes used by the section including its heap storage
+    size_t memoryUsage() const {
+        return sizeof(ChunkSection) + palette.capacity() * sizeof(BlockId) + data.capacity() * sizeof(std::uint64_t);
+    }
+};
+
+// class to store the blocks of a 16x256x16 chunk column as a stack of sections
+class Chunk {
+public:
+    static const int SIZE = ChunkSection::SIZE;
+    static const int HEIGHT = 256;
+    static const int SECTIONS = HEIGHT / ChunkSection::SIZE;
+    static const size_t MAX_SERIALIZED_SIZE = SECTIONS * ChunkSection::MAX_SERIALIZED_SIZE;
+
+private:
+    ChunkSection sections[SECTIONS];
+
+public:
+    // returns the block type at the local coords, air above the chunk
+    BlockId get(int x, int y, int z) const {
+        if (y < 0 || y >= HEIGHT) {
+            return block_air;
+        }
+        return sections[y / ChunkSection::SIZE].get(x, y % ChunkSection::SIZE, z);
+    }
+
+    void set(int x, int y, int z, BlockId id) {
+        sections[y / ChunkSection::SIZE].set(x, y % ChunkSection::SIZE, z, id);
+    }
+
+    // fills the whole chunk with air, the sections keep their storage
+    void clear() {
+        for (int s = 0; s < SECTIONS; s++) {
+            sections[s].fill(block_air);
+        }
+    }
+
+    void compact() {
+        for (int s = 0; s < SECTIONS; s++) {
+            sections[s].compact();
+        }
+    }
+
+    ChunkSection &section(int s) {
+        return sections[s];
+    }
+
+    const ChunkSection &section(int s) const {
+        return sections[s];
+    }
+
+    // appends the sections of the chunk to out, bottom to top
+    void serialize(std::vector<unsigned char> &out) const {
+        for (int s = 0; s < SECTIONS; s++) {
+            sections[s].serialize(out);
+        }
+    }
+
+    // reads a chunk written by serialize
+    // @return false if in is too short or malformed, the chunk is then cleared
+    bool deserialize(const unsigned char *in, size_t length) {
+        for (int s = 0; s < SECTIONS; s++) {
+            size_t read = sections[s].deserialize(in, length);
+            if (read == 0) {
+                clear();
+                return false;
+            }
+            in += read;
+            length -= read;
+        }
+        return true;
+    }
+
+    // calls fn(x, y, z, id) for every block that isn't air, skipping sections of only air
+    template <typename Fn>
+    void forEachSolid(Fn fn) const {
+        for (int s = 0; s < SECTIONS; s++) {
+            const ChunkSection &section = sections[s];
+            if (section.isUniform() && section.uniformId() == block_air) {
+                continue;
+            }
+            int yBase = s * ChunkSection::SIZE;
+            section.forEach([&](int x, int y, int z, BlockId id) {
+                if (id != block_air) {
+                    fn(x, yBase + y, z, id);
+                }
+            });
+        }
+    }
+
+    size_t memoryUsage() const {
+        size_t bytes = sizeof(Chunk);
+        for (int s = 0; s < SECTIONS; s++) {
+            bytes += sections[s].memoryUsage() - sizeof(ChunkSection);
+        }
+        return bytes;
+    }
+};
+
+#endif
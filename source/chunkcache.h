@@ -0,0 +1,416 @@
+#ifndef CHUNKCACHE_H
+#define CHUNKCACHE_H
+
+#include <chunk.h>
+#include <rlechunk.h>
+#include <codec.h>
+#include <region.h>
+#include <terraingen.h>
+#include <arena.h>
+#include <memorytracker.h>
+#include <trace.h>
+
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <list>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// counters of the chunk cache
+struct CacheStats {
+    size_t hotHits = 0;
+    size_t warmHits = 0;
+    size_t diskLoads = 0;
+    size_t generated = 0;
+    size_t hotEvictions = 0;
+    size_t warmEvictions = 0;
+    size_t diskWrites = 0;
+    // warm entries that failed to decompress, and those of them that had changes not on disk yet
+    size_t warmFailures = 0;
+    size_t lostChanges = 0;
+};
+
+// how the hot tier keeps decoded chunks, the warm tier and the disk always hold serialized Chunks
+enum chunk_format {
+    // palette packed sections in a Chunk, any block is read in constant time
+    chunk_sections,
+    // run-length encoded columns in a RleChunk, the memory follows the surface instead of the
+    // volume. chunks are converted from and to sections when they move to and from the warm tier
+    chunk_runs
+};
+
+// class to keep recently used chunks in memory in two tiers. the hot tier holds decoded chunks
+// (and, through attach(), the render data built from them), the warm tier holds chunks compressed.
+// chunks least recently used are moved hot -> warm -> disk when a tier goes over its byte budget,
+// so coming back to a recent area costs a decompress instead of generating the noise again
+class ChunkCache {
+public:
+    typedef std::pair<int, int> Key;
+
+    struct KeyHash {
+        size_t operator()(const Key &key) const {
+            return std::hash<std::uint64_t>()(((std::uint64_t)(std::uint32_t)key.first << 32) | (std::uint32_t)key.second);
+        }
+    };
+
+private:
+
+    struct HotEntry {
+        // the decoded chunk in the format of the cache, the other one is null
+        Chunk *chunk;
+        RleChunk *runs;
+        // bytes of the chunk and of the render data attached to it
+        size_t bytes;
+        size_t attached;
+        int pins;
+        // true if the chunk isn't on disk yet
+        bool dirty;
+        std::list<Key>::iterator lru;
+    };
+
+    struct WarmEntry {
+        // the codec of the payload, stored if the one of the cache failed to compress the chunk
+        const Codec *codec;
+        std::vector<unsigned char> payload;
+        size_t rawSize;
+        bool dirty;
+        std::list<Key>::iterator lru;
+    };
+
+    Terrain &terrain;
+    RegionStore *store;
+    const Codec *codec;
+    size_t hotBudget;
+    size_t warmBudget;
+    size_t hotBytes = 0;
+    size_t warmBytes = 0;
+    // most recently used at the front
+    std::list<Key> hotLru;
+    std::list<Key> warmLru;
+    std::unordered_map<Key, HotEntry, KeyHash> hot;
+    std::unordered_map<Key, WarmEntry, KeyHash> warm;
+    chunk_format format;
+    BufferPool<Chunk> chunks;
+    BufferPool<RleChunk> runChunks;
+    // sections of a chunk kept as runs, while it is converted
+    Chunk converted;
+    Arena scratch;
+    std::vector<unsigned char> raw;
+    CacheStats stats;
+    std::function<void(int, int)> evictListener;
+    MemoryTracker &memory = MemoryTracker::instance();
+
+    // returns true while the hot tier or a tag it holds is over its budget
+    bool hotOverBudget() {
+        return hotBytes > hotBudget || memory.overBudget(mem_terrain) || memory.overBudget(mem_mesh);
+    }
+
+    bool warmOverBudget() {
+        return warmBytes > warmBudget || memory.overBudget(mem_caches);
+    }
+
+    // reads a chunk missing in the hot tier from the warm tier or the disk into chunk
+    // @return false if it is in neither
+    bool fetchStored(const Key &key, Chunk &chunk, bool &dirty) {
+        std::unordered_map<Key, WarmEntry, KeyHash>::iterator it = warm.find(key);
+        if (it != warm.end()) {
+            TraceScope scope("decompress chunk", "cx", key.first, "cz", key.second);
+            WarmEntry &entry = it->second;
+            if (entry.codec->decompress(entry.payload.data(), entry.payload.size(), raw, entry.rawSize)
+                    && chunk.deserialize(raw.data(), raw.size())) {
+                ++stats.warmHits;
+                dirty = entry.dirty;
+                warmBytes -= entry.payload.capacity();
+                memory.remove(mem_caches, entry.payload.capacity());
+                warmLru.erase(entry.lru);
+                warm.erase(it);
+                return true;
+            }
+            // the payload can't be read back, so the chunk comes from disk or the generator again
+            ++stats.warmFailures;
+            if (entry.dirty) {
+                ++stats.lostChanges;
+                std::cout << "Failed to decompress chunk " << key.first << ", " << key.second
+                          << " from the warm cache, its unsaved changes are lost" << std::endl;
+            } else {
+                std::cout << "Failed to decompress chunk " << key.first << ", " << key.second
+                          << " from the warm cache, reloading it" << std::endl;
+            }
+            warmBytes -= entry.payload.capacity();
+            memory.remove(mem_caches, entry.payload.capacity());
+            warmLru.erase(entry.lru);
+            warm.erase(it);
+        }
+        if (store != nullptr) {
+            TraceScope scope("load chunk", "cx", key.first, "cz", key.second);
+            if (store->load(key.first, key.second, chunk)) {
+                ++stats.diskLoads;
+                dirty = false;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // fetches a chunk missing in the hot tier into a pooled chunk of the format of the cache,
+    // generating it if it isn't stored
+    void fetch(const Key &key, HotEntry &entry) {
+        entry.chunk = nullptr;
+        entry.runs = nullptr;
+        if (format == chunk_runs) {
+            entry.runs = runChunks.acquire();
+            if (fetchStored(key, converted, entry.dirty)) {
+                entry.runs->fromChunk(converted);
+                return;
+            }
+        } else {
+            entry.chunk = chunks.acquire();
+            if (fetchStored(key, *entry.chunk, entry.dirty)) {
+                return;
+            }
+        }
+        TraceScope scope("generate chunk", "cx", key.first, "cz", key.second);
+        if (entry.runs != nullptr) {
+            terrain.genChunk(key.first, key.second, scratch, *entry.runs);
+        } else {
+            terrain.genChunk(key.first, key.second, scratch, *entry.chunk);
+        }
+        scratch.reset();
+        ++stats.generated;
+        // only worth writing if there is a disk tier to write to
+        entry.dirty = store != nullptr;
+    }
+
+    // returns the chunk of an entry as sections, converted if the cache keeps runs
+    const Chunk &sections(const HotEntry &entry) {
+        if (entry.runs == nullptr) {
+            return *entry.chunk;
+        }
+        entry.runs->toChunk(converted);
+        return converted;
+    }
+
+    // returns a hot chunk to its pool
+    void releaseChunk(HotEntry &entry) {
+        if (entry.runs != nullptr) {
+            runChunks.release(entry.runs);
+        } else {
+            chunks.release(entry.chunk);
+        }
+    }
+
+    // returns the entry of the chunk at cx, cz, fetching it first if it isn't hot, and pins it
+    HotEntry &acquireEntry(int cx, int cz) {
+        Key key(cx, cz);
+        std::unordered_map<Key, HotEntry, KeyHash>::iterator it = hot.find(key);
+        if (it != hot.end()) {
+            ++stats.hotHits;
+            ++it->second.pins;
+            hotLru.splice(hotLru.begin(), hotLru, it->second.lru);
+            return it->second;
+        }
+        HotEntry entry;
+        fetch(key, entry);
+        entry.bytes = entry.runs != nullptr ? entry.runs->memoryUsage() : entry.chunk->memoryUsage();
+        entry.attached = 0;
+        entry.pins = 1;
+        hotLru.push_front(key);
+        entry.lru = hotLru.begin();
+        hot[key] = entry;
+        hotBytes += entry.bytes;
+        memory.add(mem_terrain, entry.bytes);
+        trim();
+        // pinned, so trim() left it hot
+        return hot.find(key)->second;
+    }
+
+    // moves the least recently used unpinned hot chunk to the warm tier
+    bool demoteHot() {
+        for (std::list<Key>::reverse_iterator it = hotLru.rbegin(); it != hotLru.rend(); ++it) {
+            HotEntry &entry = hot[*it];
+            if (entry.pins > 0) {
+                continue;
+            }
+            Key key = *it;
+            TraceScope scope("compress chunk", "cx", key.first, "cz", key.second);
+            WarmEntry &warmEntry = warm[key];
+            raw.clear();
+            sections(entry).serialize(raw);
+            warmEntry.codec = codec;
+            if (!codec->compress(raw.data(), raw.size(), warmEntry.payload)) {
+                warmEntry.codec = findCodec(codec_stored);
+                warmEntry.payload = raw;
+            }
+            warmEntry.payload.shrink_to_fit();
+            warmEntry.rawSize = raw.size();
+            warmEntry.dirty = entry.dirty;
+            warmLru.push_front(key);
+            warmEntry.lru = warmLru.begin();
+            warmBytes += warmEntry.payload.capacity();
+            memory.add(mem_caches, warmEntry.payload.capacity());
+
+            releaseChunk(entry);
+            hotBytes -= entry.bytes;
+            memory.remove(mem_terrain, entry.bytes - entry.attached);
+            memory.remove(mem_mesh, entry.attached);
+            hotLru.erase(entry.lru);
+            hot.erase(key);
+            ++stats.hotEvictions;
+            if (evictListener) {
+                evictListener(key.first, key.second);
+            }
+            return true;
+        }
+        return false;
+    }
+
+    // drops the least recently used warm chunk, writing it to disk first if it isn't there
+    void evictWarm() {
+        Key key = warmLru.back();
+        WarmEntry &entry = warm[key];
+        if (entry.dirty && store != nullptr) {
+            if (store->savePayload(key.first, key.second, entry.payload.data(), entry.payload.size(), entry.codec->id(), entry.rawSize)) {
+                ++stats.diskWrites;
+            }
+        }
+        warmBytes -= entry.payload.capacity();
+        memory.remove(mem_caches, entry.payload.capacity());
+        warmLru.pop_back();
+        warm.erase(key);
+        ++stats.warmEvictions;
+    }
+
+public:
+    // @param store the disk tier, null to drop chunks evicted from the warm tier
+    // @param hotBudget bytes of decoded chunks and their render data to keep
+    // @param warmBudget bytes of compressed chunks to keep
+    // @param codec the codec of the warm tier, null for the one of the store or lz without one.
+    //        evicted chunks are written to disk as they are, without compressing them again
+    // @param format how hot chunks are kept, acquire() hands them out as sections and
+    //        acquireRuns() as runs
+    ChunkCache(Terrain &terrain, RegionStore *store, size_t hotBudget, size_t warmBudget, const Codec *codec = nullptr,
+            chunk_format format = chunk_sections)
+        :terrain(terrain), store(store), codec(codec), hotBudget(hotBudget), warmBudget(warmBudget), format(format),
+        chunks(1), runChunks(1) {
+        if (this->codec == nullptr) {
+            this->codec = store != nullptr ? store->getCodec() : findCodec(codec_lz);
+        }
+    }
+
+    ~ChunkCache() {
+        flush();
+        for (std::unordered_map<Key, HotEntry, KeyHash>::iterator it = hot.begin(); it != hot.end(); ++it) {
+            memory.remove(mem_terrain, it->second.bytes - it->second.attached);
+            memory.remove(mem_mesh, it->second.attached);
+        }
+        memory.remove(mem_caches, warmBytes);
+    }
+
+    ChunkCache(const ChunkCache&) = delete;
+    ChunkCache &operator=(const ChunkCache&) = delete;
+
+    // calls listener(cx, cz) when a chunk leaves the hot tier, to release its render data
+    void setEvictListener(std::function<void(int, int)> listener) {
+        evictListener = listener;
+    }
+
+    // returns the chunk at cx, cz and pins it in the hot tier until release() is called.
+    // null if the cache keeps chunk_runs
+    Chunk *acquire(int cx, int cz) {
+        return acquireEntry(cx, cz).chunk;
+    }
+
+    // returns the run-length chunk at cx, cz and pins it like acquire(), null if the cache keeps
+    // chunk_sections
+    RleChunk *acquireRuns(int cx, int cz) {
+        return acquireEntry(cx, cz).runs;
+    }
+
+    chunk_format getFormat() {
+        return format;
+    }
+
+    // unpins a chunk returned by acquire(), it stays hot until the budget needs the room
+    void release(int cx, int cz) {
+        std::unordered_map<Key, HotEntry, KeyHash>::iterator it = hot.find(Key(cx, cz));
+        if (it != hot.end() && it->second.pins > 0) {
+            --it->second.pins;
+        }
+    }
+
+    // accounts bytes of render data built from a hot chunk against the hot budget, replacing the
+    // bytes attached before (e.g. by a mesh built again)
+    void attach(int cx, int cz, size_t bytes) {
+        std::unordered_map<Key, HotEntry, KeyHash>::iterator it = hot.find(Key(cx, cz));
+        if (it != hot.end()) {
+            it->second.bytes = it->second.bytes - it->second.attached + bytes;
+            hotBytes = hotBytes - it->second.attached + bytes;
+            memory.remove(mem_mesh, it->second.attached);
+            memory.add(mem_mesh, bytes);
+            it->second.attached = bytes;
+        }
+    }
+
+    // evicts least recently used chunks until both tiers are within budget, and the terrain, mesh
+    // and caches tags within the budgets of the MemoryTracker. pinned chunks are never evicted
+    // so the hot tier may stay over budget
+    void trim() {
+        while (hotOverBudget() && demoteHot()) {
+        }
+        while (warmOverBudget() && !warmLru.empty()) {
+            evictWarm();
+        }
+    }
+
+    // changes the budgets, e.g. when memory gets tight
+    void setBudgets(size_t hot, size_t warm) {
+        hotBudget = hot;
+        warmBudget = warm;
+        trim();
+    }
+
+    // writes every chunk not on disk yet to the disk tier
+    void flush() {
+        if (store == nullptr) {
+            return;
+        }
+        for (std::unordered_map<Key, HotEntry, KeyHash>::iterator it = hot.begin(); it != hot.end(); ++it) {
+            if (it->second.dirty && store->save(it->first.first, it->first.second, sections(it->second))) {
+                it->second.dirty = false;
+                ++stats.diskWrites;
+            }
+        }
+        for (std::unordered_map<Key, WarmEntry, KeyHash>::iterator it = warm.begin(); it != warm.end(); ++it) {
+            WarmEntry &entry = it->second;
+            if (entry.dirty && store->savePayload(it->first.first, it->first.second,
+                    entry.payload.data(), entry.payload.size(), entry.codec->id(), entry.rawSize)) {
+                entry.dirty = false;
+                ++stats.diskWrites;
+            }
+        }
+    }
+
+    size_t getHotBytes() {
+        return hotBytes;
+    }
+
+    size_t getWarmBytes() {
+        return warmBytes;
+    }
+
+    size_t hotCount() {
+        return hot.size();
+    }
+
+    size_t warmCount() {
+        return warm.size();
+    }
+
+    const CacheStats &getStats() {
+        return stats;
+    }
+};
+
+#endif
@@ -0,0 +1,346 @@
+#include <codec.h>
+#include <chunk.h>
+
+#include <cstdint>
+#include <cstring>
+
+#ifdef TERRAIN_HAVE_ZSTD
+#include <zstd.h>
+#endif
+#ifdef TERRAIN_HAVE_LZ4
+#include <lz4.h>
+#endif
+
+namespace {
+
+// copies the payload as is
+class StoredCodec : public Codec {
+public:
+    unsigned int id() const {
+        return codec_stored;
+    }
+
+    const char *name() const {
+        return "stored";
+    }
+
+    bool compress(const unsigned char *in, size_t size, std::vector<unsigned char> &out) const {
+        out.assign(in, in + size);
+        return true;
+    }
+
+    bool decompress(const unsigned char *in, size_t size, std::vector<unsigned char> &out, size_t rawSize) const {
+        if (size != rawSize || rawSize > Chunk::MAX_SERIALIZED_SIZE) {
+            return false;
+        }
+        out.assign(in, in + size);
+        return true;
+    }
+};
+
+// byte-oriented run-length coding: a control byte below 128 is followed by that many + 1
+// literal bytes, otherwise the next byte repeats control - 125 times
+class RleCodec : public Codec {
+public:
+    unsigned int id() const {
+        return codec_rle;
+    }
+
+    const char *name() const {
+        return "rle";
+    }
+
+    bool compress(const unsigned char *in, size_t size, std::vector<unsigned char> &out) const {
+        out.clear();
+        size_t i = 0;
+        while (i < size) {
+            size_t run = 1;
+            while (i + run < size && run < 130 && in[i + run] == in[i]) {
+                run++;
+            }
+            if (run >= 3) {
+                out.push_back((unsigned char)(run + 125));
+                out.push_back(in[i]);
+                i += run;
+                continue;
+            }
+            // literals until the next run of 3 or the maximum of 128
+            size_t start = i;
+            while (i < size && i - start < 128) {
+                if (i + 2 < size && in[i] == in[i + 1] && in[i] == in[i + 2]) {
+                    break;
+                }
+                i++;
+            }
+            out.push_back((unsigned char)(i - start - 1));
+            out.insert(out.end(), in + start, in + i);
+        }
+        return true;
+    }
+
+    bool decompress(const unsigned char *in, size_t size, std::vector<unsigned char> &out, size_t rawSize) const {
+        out.clear();
+        if (rawSize > Chunk::MAX_SERIALIZED_SIZE) {
+            return false;
+        }
+        size_t i = 0;
+        while (i < size && out.size() <= rawSize) {
+            unsigned int control = in[i++];
+            if (control < 128) {
+                size_t count = control + 1;
+                if (i + count > size) {
+                    return false;
+                }
+                out.insert(out.end(), in + i, in + i + count);
+                i += count;
+            } else {
+                if (i >= size) {
+                    return false;
+                }
+                out.insert(out.end(), control - 125, in[i++]);
+            }
+        }
+        return out.size() == rawSize;
+    }
+};
+
+// LZ77 with a single-probe hash table over 4 byte prefixes. a sequence is a token (literal count
+// in the high, match length - 4 in the low nibble, 15 meaning more length bytes follow), the
+// literals and a 2 byte offset of the match. the last sequence has literals only
+class LzCodec : public Codec {
+private:
+    static const int HASH_BITS = 12;
+    static const size_t MIN_MATCH = 4;
+    static const size_t MAX_OFFSET = 65535;
+
+    static std::uint32_t read32(const unsigned char *p) {
+        std::uint32_t value;
+        memcpy(&value, p, 4);
+        return value;
+    }
+
+    static std::uint32_t hash(std::uint32_t value) {
+        return (value * 2654435761u) >> (32 - HASH_BITS);
+    }
+
+    static void putLength(std::vector<unsigned char> &out, size_t length) {
+        while (length >= 255) {
+            out.push_back(255);
+            length -= 255;
+        }
+        out.push_back((unsigned char)length);
+    }
+
+    static void putSequence(std::vector<unsigned char> &out, const unsigned char *literals, size_t literalCount,
+            size_t offset, size_t matchLength) {
+        size_t match = matchLength >= MIN_MATCH ? matchLength - MIN_MATCH : 0;
+        out.push_back((unsigned char)(((literalCount < 15 ? literalCount : 15) << 4) | (match < 15 ? match : 15)));
+        if (literalCount >= 15) {
+            putLength(out, literalCount - 15);
+        }
+        out.insert(out.end(), literals, literals + literalCount);
+        if (matchLength == 0) {
+            return;
+        }
+        out.push_back((unsigned char)offset);
+        out.push_back((unsigned char)(offset >> 8));
+        if (match >= 15) {
+            putLength(out, match - 15);
+        }
+    }
+
+    static bool getLength(const unsigned char *in, size_t size, size_t &i, size_t &length) {
+        unsigned char byte;
+        do {
+            if (i >= size) {
+                return false;
+            }
+            byte = in[i++];
+            length += byte;
+        } while (byte == 255);
+        return true;
+    }
+
+public:
+    unsigned int id() const {
+        return codec_lz;
+    }
+
+    const char *name() const {
+        return "lz";
+    }
+
+    bool compress(const unsigned char *in, size_t size, std::vector<unsigned char> &out) const {
+        out.clear();
+        std::uint32_t table[1 << HASH_BITS];
+        memset(table, 0, sizeof(table));
+        size_t anchor = 0;
+        size_t i = 0;
+        while (i + MIN_MATCH <= size) {
+            std::uint32_t h = hash(read32(in + i));
+            size_t candidate = table[h];
+            table[h] = i;
+            if (candidate >= i || i - candidate > MAX_OFFSET || read32(in + candidate) != read32(in + i)) {
+                i++;
+                continue;
+            }
+            size_t length = MIN_MATCH;
+            while (i + length < size && in[candidate + length] == in[i + length]) {
+                length++;
+            }
+            putSequence(out, in + anchor, i - anchor, i - candidate, length);
+            i += length;
+            anchor = i;
+        }
+        putSequence(out, in + anchor, size - anchor, 0, 0);
+        return true;
+    }
+
+    bool decompress(const unsigned char *in, size_t size, std::vector<unsigned char> &out, size_t rawSize) const {
+        out.clear();
+        // rawSize comes from the header of the payload, so it is bounded before reserving it
+        if (rawSize > Chunk::MAX_SERIALIZED_SIZE) {
+            return false;
+        }
+        out.reserve(rawSize);
+        size_t i = 0;
+        while (i < size) {
+            unsigned char token = in[i++];
+            size_t literals = token >> 4;
+            if (literals == 15 && !getLength(in, size, i, literals)) {
+                return false;
+            }
+            if (i + literals > size || out.size() + literals > rawSize) {
+                return false;
+            }
+            out.insert(out.end(), in + i, in + i + literals);
+            i += literals;
+            if (i == size) {
+                break;
+            }
+            if (i + 2 > size) {
+                return false;
+            }
+            size_t offset = in[i] | (in[i + 1] << 8);
+            i += 2;
+            size_t length = token & 15;
+            if (length == 15 && !getLength(in, size, i, length)) {
+                return false;
+            }
+            length += MIN_MATCH;
+            if (offset == 0 || offset > out.size() || out.size() + length > rawSize) {
+                return false;
+            }
+            // byte by byte, the match may overlap the bytes it produces
+            size_t from = out.size() - offset;
+            for (size_t k = 0; k < length; k++) {
+                out.push_back(out[from + k]);
+            }
+        }
+        return out.size() == rawSize;
+    }
+};
+
+#ifdef TERRAIN_HAVE_ZSTD
+class ZstdCodec : public Codec {
+public:
+    unsigned int id() const {
+        return codec_zstd;
+    }
+
+    const char *name() const {
+        return "zstd";
+    }
+
+    bool compress(const unsigned char *in, size_t size, std::vector<unsigned char> &out) const {
+        out.resize(ZSTD_compressBound(size));
+        size_t written = ZSTD_compress(out.data(), out.size(), in, size, 1);
+        out.resize(ZSTD_isError(written) ? 0 : written);
+        return !ZSTD_isError(written);
+    }
+
+    bool decompress(const unsigned char *in, size_t size, std::vector<unsigned char> &out, size_t rawSize) const {
+        if (rawSize > Chunk::MAX_SERIALIZED_SIZE) {
+            return false;
+        }
+        out.resize(rawSize);
+        size_t read = ZSTD_decompress(out.data(), rawSize, in, size);
+        return !ZSTD_isError(read) && read == rawSize;
+    }
+};
+#endif
+
+#ifdef TERRAIN_HAVE_LZ4
+class Lz4Codec : public Codec {
+public:
+    unsigned int id() const {
+        return codec_lz4;
+    }
+
+    const char *name() const {
+        return "lz4";
+    }
+
+    bool compress(const unsigned char *in, size_t size, std::vector<unsigned char> &out) const {
+        out.resize(LZ4_compressBound((int)size));
+        int written = LZ4_compress_default((const char*)in, (char*)out.data(), (int)size, (int)out.size());
+        out.resize(written > 0 ? written : 0);
+        return written > 0;
+    }
+
+    bool decompress(const unsigned char *in, size_t size, std::vector<unsigned char> &out, size_t rawSize) const {
+        if (rawSize > Chunk::MAX_SERIALIZED_SIZE) {
+            return false;
+        }
+        out.resize(rawSize);
+        int read = LZ4_decompress_safe((const char*)in, (char*)out.data(), (int)size, (int)rawSize);
+        return read >= 0 && (size_t)read == rawSize;
+    }
+};
+#endif
+
+}
+
+const std::vector<const Codec*> &availableCodecs() {
+    static StoredCodec stored;
+    static RleCodec rle;
+    static LzCodec lz;
+#ifdef TERRAIN_HAVE_ZSTD
+    static ZstdCodec zstd;
+#endif
+#ifdef TERRAIN_HAVE_LZ4
+    static Lz4Codec lz4;
+#endif
+    static std::vector<const Codec*> codecs = {
+        &stored,
+        &rle,
+        &lz,
+#ifdef TERRAIN_HAVE_ZSTD
+        &zstd,
+#endif
+#ifdef TERRAIN_HAVE_LZ4
+        &lz4,
+#endif
+    };
+    return codecs;
+}
+
+const Codec *findCodec(unsigned int id) {
+    const std::vector<const Codec*> &codecs = availableCodecs();
+    for (size_t i = 0; i < codecs.size(); i++) {
+        if (codecs[i]->id() == id) {
+            return codecs[i];
+        }
+    }
+    return nullptr;
+}
+
+const Codec *findCodec(const std::string &name) {
+    const std::vector<const Codec*> &codecs = availableCodecs();
+    for (size_t i = 0; i < codecs.size(); i++) {
+        if (name == codecs[i]->name()) {
+            return codecs[i];
+        }
+    }
+    return nullptr;
+}
@@ -0,0 +1,44 @@
+#ifndef CODEC_H
+#define CODEC_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// ids of the chunk payload codecs, stored with every payload so they must never change
+enum chunk_codec {
+    codec_stored = 0,
+    codec_rle = 1,
+    codec_lz = 2,
+    codec_zstd = 3,
+    codec_lz4 = 4
+};
+
+// interface of a codec compressing chunk payloads in memory and on disk.
+// codecs are stateless and shared, zstd and lz4 are only available if found at build time
+class Codec {
+public:
+    virtual ~Codec() {}
+
+    virtual unsigned int id() const = 0;
+
+    virtual const char *name() const = 0;
+
+    // replaces out with the compressed form of in
+    // @return false if the library failed to compress it, out is then empty
+    virtual bool compress(const unsigned char *in, size_t size, std::vector<unsigned char> &out) const = 0;
+
+    // replaces out with the rawSize bytes in decompresses to
+    // @return false if in is malformed, doesn't decompress to rawSize bytes or rawSize is larger
+    //         than any serialized chunk, which only a corrupt header asks for
+    virtual bool decompress(const unsigned char *in, size_t size, std::vector<unsigned char> &out, size_t rawSize) const = 0;
+};
+
+// returns the codec with the given id or name, null if it isn't available in this build
+const Codec *findCodec(unsigned int id);
+const Codec *findCodec(const std::string &name);
+
+// returns every codec available in this build
+const std::vector<const Codec*> &availableCodecs();
+
+#endif
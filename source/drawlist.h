@@ -0,0 +1,279 @@
+#ifndef DRAWLIST_H
+#define DRAWLIST_H
+
+#include <glad/glad.h>
+#include <includes/glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+// class to skip binds of GL objects that are already bound. everything drawn through it has to
+// bind through it too, code binding on its own (e.g. the HUD) must be followed by invalidate()
+class GlStateCache {
+private:
+    static const int TEXTURE_UNITS = 4;
+
+    unsigned int program;
+    unsigned int vao;
+    unsigned int activeUnit;
+    unsigned int textures[TEXTURE_UNITS];
+    // binds actually issued since the last resetChanges()
+    size_t changes = 0;
+
+public:
+    GlStateCache() {
+        invalidate();
+    }
+
+    // forgets what is bound, the next bind of every kind is issued
+    void invalidate() {
+        program = ~0u;
+        vao = ~0u;
+        activeUnit = ~0u;
+        for (int u = 0; u < TEXTURE_UNITS; u++) {
+            textures[u] = ~0u;
+        }
+    }
+
+    void useProgram(unsigned int id) {
+        if (program != id) {
+            glUseProgram(id);
+            program = id;
+            ++changes;
+        }
+    }
+
+    void bindVertexArray(unsigned int id) {
+        if (vao != id) {
+            glBindVertexArray(id);
+            vao = id;
+            ++changes;
+        }
+    }
+
+    // binds a 2D texture to a unit below TEXTURE_UNITS
+    void bindTexture(unsigned int unit, unsigned int id) {
+        if (textures[unit] == id) {
+            return;
+        }
+        if (activeUnit != unit) {
+            glActiveTexture(GL_TEXTURE0 + unit);
+            activeUnit = unit;
+        }
+        glBindTexture(GL_TEXTURE_2D, id);
+        textures[unit] = id;
+        ++changes;
+    }
+
+    size_t getChanges() {
+        return changes;
+    }
+
+    void resetChanges() {
+        changes = 0;
+    }
+};
+
+// the GL objects a draw binds
+struct DrawMaterial {
+    unsigned int program;
+    unsigned int vao;
+    unsigned int texture;
+};
+
+// a submission of the draw list, a range of 16 bit indices of the VAO of its material.
+// the key orders it by state and then by the distance of its center from the camera
+struct DrawItem {
+    std::uint64_t key;
+    glm::vec3 center;
+    unsigned int material;
+    int count;
+    size_t firstIndex;
+    int baseVertex;
+};
+
+// class to collect indexed draws and submit them sorted by a 64 bit key of program, VAO, texture
+// and depth bucket. every state is bound once per frame instead of once per draw, draws of the
+// same state go front to back so early depth testing rejects what they hide and, where the
+// context has it, are issued as a single multi-draw
+class DrawList {
+private:
+    // GL names are small integers, 12 bits each keep them apart
+    static const int NAME_BITS = 12;
+    static const int DEPTH_BITS = 16;
+    // depth buckets per block of distance
+    static const int DEPTH_SCALE = 4;
+
+    std::vector<DrawMaterial> materials;
+    std::vector<DrawItem> items;
+    // the other buffer of the radix sort
+    std::vector<DrawItem> sorted;
+    // arguments of the multi-draw of a run of items with the same material
+    std::vector<GLsizei> counts;
+    std::vector<const void*> offsets;
+    std::vector<GLint> baseVertices;
+
+    static std::uint64_t field(unsigned int value, int bits, int shift) {
+        return (std::uint64_t)(value & ((1u << bits) - 1)) << shift;
+    }
+
+public:
+    // returns the key of a draw, only its order matters
+    // @param distance the distance from the camera, clamped to the deepest bucket
+    static std::uint64_t makeKey(const DrawMaterial &material, float distance) {
+        float bucket = distance * DEPTH_SCALE;
+        unsigned int depth = bucket >= (1 << DEPTH_BITS) - 1 ? (1 << DEPTH_BITS) - 1 : (unsigned int)bucket;
+        return field(material.program, NAME_BITS, 64 - NAME_BITS)
+            | field(material.vao, NAME_BITS, 64 - 2 * NAME_BITS)
+            | field(material.texture, NAME_BITS, 64 - 3 * NAME_BITS)
+            | field(depth, DEPTH_BITS, 64 - 3 * NAME_BITS - DEPTH_BITS);
+    }
+
+    // registers a material
+    // @return the id to add draws of it with
+    unsigned int addMaterial(const DrawMaterial &material) {
+        materials.push_back(material);
+        return materials.size() - 1;
+    }
+
+    // makes room for draws so adding them never allocates
+    void reserve(size_t draws) {
+        items.reserve(draws);
+        sorted.reserve(draws);
+        counts.reserve(draws);
+        offsets.reserve(draws);
+        baseVertices.reserve(draws);
+    }
+
+    size_t capacity() {
+        return items.capacity();
+    }
+
+    size_t size() {
+        return items.size();
+    }
+
+    void clear() {
+        items.clear();
+    }
+
+    // queues a draw of count indices of a material, nothing is queued for 0
+    // @param center the middle of what is drawn, for the depth bucket
+    void add(unsigned int material, size_t firstIndex, int count, int baseVertex, glm::vec3 center) {
+        if (count == 0) {
+            return;
+        }
+        DrawItem item;
+        item.key = 0;
+        item.center = center;
+        item.material = material;
+        item.count = count;
+        item.firstIndex = firstIndex;
+        item.baseVertex = baseVertex;
+        items.push_back(item);
+    }
+
+    // keys the queued draws by their distance from eye and sorts them, call after adding them and
+    // whenever the camera moves. an LSD radix sort a byte at a time, skipping the bytes every key
+    // shares (the state of the few materials mostly), so it stays linear in the number of draws
+    void sort(glm::vec3 eye) {
+        for (size_t i = 0; i < items.size(); i++) {
+            items[i].key = makeKey(materials[items[i].material], glm::length(items[i].center - eye));
+        }
+        sorted.resize(items.size());
+        for (int shift = 0; shift < 64; shift += 8) {
+            size_t offsets[257] = { 0 };
+            for (size_t i = 0; i < items.size(); i++) {
+                ++offsets[((items[i].key >> shift) & 0xff) + 1];
+            }
+            if (items.empty() || offsets[((items[0].key >> shift) & 0xff) + 1] == items.size()) {
+                continue;
+            }
+            for (int b = 0; b < 256; b++) {
+                offsets[b + 1] += offsets[b];
+            }
+            for (size_t i = 0; i < items.size(); i++) {
+                sorted[offsets[(items[i].key >> shift) & 0xff]++] = items[i];
+            }
+            items.swap(sorted);
+        }
+    }
+
+    // draws everything queued, binding through state
+    // @param multiDraw false to issue a draw call per item even if glMultiDrawElementsBaseVertex is there
+    // @param triangles incremented by the triangles drawn
+    // @return the number of draw calls
+    size_t submit(GlStateCache &state, bool multiDraw, size_t &triangles) {
+        multiDraw = multiDraw && glMultiDrawElementsBaseVertex != NULL;
+        size_t drawCalls = 0;
+        for (size_t run = 0; run < items.size();) {
+            const DrawMaterial &material = materials[items[run].material];
+            state.useProgram(material.program);
+            state.bindVertexArray(material.vao);
+            state.bindTexture(0, material.texture);
+            size_t end = run;
+            counts.clear();
+            offsets.clear();
+            baseVertices.clear();
+            for (; end < items.size() && items[end].material == items[run].material; end++) {
+                const DrawItem &item = items[end];
+                const void *offset = (const void*)(item.firstIndex * sizeof(unsigned short));
+                triangles += item.count / 3;
+                if (multiDraw) {
+                    counts.push_back(item.count);
+                    offsets.push_back(offset);
+                    baseVertices.push_back(item.baseVertex);
+                } else {
+                    glDrawElementsBaseVertex(GL_TRIANGLES, item.count, GL_UNSIGNED_SHORT, (void*)offset, item.baseVertex);
+                    ++drawCalls;
+                }
+            }
+            if (multiDraw) {
+                glMultiDrawElementsBaseVertex(GL_TRIANGLES, counts.data(), GL_UNSIGNED_SHORT,
+                    offsets.data(), counts.size(), baseVertices.data());
+                ++drawCalls;
+            }
+            run = end;
+        }
+        return drawCalls;
+    }
+
+    // draws everything queued with program and no textures, e.g. into the depth buffer only.
+    // runs of the same VAO are a single multi-draw since the materials don't matter
+    // @return the number of draw calls
+    size_t submitDepth(GlStateCache &state, unsigned int program, bool multiDraw, size_t &triangles) {
+        multiDraw = multiDraw && glMultiDrawElementsBaseVertex != NULL;
+        size_t drawCalls = 0;
+        state.useProgram(program);
+        for (size_t run = 0; run < items.size();) {
+            unsigned int vao = materials[items[run].material].vao;
+            state.bindVertexArray(vao);
+            size_t end = run;
+            counts.clear();
+            offsets.clear();
+            baseVertices.clear();
+            for (; end < items.size() && materials[items[end].material].vao == vao; end++) {
+                const DrawItem &item = items[end];
+                const void *offset = (const void*)(item.firstIndex * sizeof(unsigned short));
+                triangles += item.count / 3;
+                if (multiDraw) {
+                    counts.push_back(item.count);
+                    offsets.push_back(offset);
+                    baseVertices.push_back(item.baseVertex);
+                } else {
+                    glDrawElementsBaseVertex(GL_TRIANGLES, item.count, GL_UNSIGNED_SHORT, (void*)offset, item.baseVertex);
+                    ++drawCalls;
+                }
+            }
+            if (multiDraw) {
+                glMultiDrawElementsBaseVertex(GL_TRIANGLES, counts.data(), GL_UNSIGNED_SHORT,
+                    offsets.data(), counts.size(), baseVertices.data());
+                ++drawCalls;
+            }
+            run = end;
+        }
+        return drawCalls;
+    }
+};
+
+#endif
@@ -0,0 +1,227 @@
+#include <terraingen.h>
+#include <arena.h>
+#include <chunk.h>
+#include <codec.h>
+#include <region.h>
+#include <trace.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// bakes a rectangle of chunks without opening a window, either as a heightmap
+// or as region files the viewer loads with --world
+
+static int floorDiv(int a, int b) {
+    return a >= 0 ? a / b : -((-a + b - 1) / b);
+}
+
+// the rectangle of chunks to export and how
+struct ExportJob {
+    int width = 100;
+    int seed = 0;
+    int originX = 0;
+    int originZ = 0;
+    int sizeX = 16;
+    int sizeZ = 16;
+    unsigned int threads = 0;
+    std::string format = "pgm";
+    std::string codecName = "rle";
+    std::string out;
+    std::string trace;
+};
+
+static void usage() {
+    std::cout << "usage: terrain_export [--width n] [--seed n] [--origin cx cz] [--size chunksX chunksZ]" << std::endl
+              << "                      [--threads n] [--format pgm|raw|region] [--codec name] [--trace file] out" << std::endl;
+}
+
+// samples the heights of every chunk of the job into heights, one row of columns after another
+static void exportHeights(const ExportJob &job, const Terrain &terrain, std::vector<std::uint16_t> &heights) {
+    const int S = Terrain::CHUNK_SIZE;
+    const int rowLength = job.sizeX * S;
+    const int chunkCount = job.sizeX * job.sizeZ;
+    heights.resize((size_t)rowLength * job.sizeZ * S);
+    std::atomic<int> next(0);
+    std::vector<std::thread> workers;
+    for (unsigned int t = 0; t < job.threads; t++) {
+        workers.push_back(std::thread([&, t]() {
+            Trace::instance().nameThread("worker " + std::to_string(t));
+            Terrain local = terrain;
+            Arena scratch;
+            for (int i = next++; i < chunkCount; i = next++) {
+                int x = i % job.sizeX;
+                int z = i / job.sizeX;
+                TraceScope scope("sample heights", "cx", job.originX + x, "cz", job.originZ + z);
+                int *chunkHeights = local.sampleHeights(job.originX + x, job.originZ + z, scratch);
+                for (int row = 0; row < S; row++) {
+                    std::uint16_t *out = &heights[(size_t)(z * S + row) * rowLength + x * S];
+                    for (int col = 0; col < S; col++) {
+                        out[col] = chunkHeights[row * S + col];
+                    }
+                }
+                scratch.reset();
+            }
+        }));
+    }
+    for (size_t t = 0; t < workers.size(); t++) {
+        workers[t].join();
+    }
+}
+
+// generates the chunks of the job into the region files of job.out, every worker
+// fills whole regions so no two of them write the same file
+// @return the number of chunks that failed to be written
+static int exportRegions(const ExportJob &job, const Terrain &terrain, const Codec *codec) {
+    const int R = RegionFile::SIZE;
+    int rx0 = floorDiv(job.originX, R);
+    int rz0 = floorDiv(job.originZ, R);
+    int rx1 = floorDiv(job.originX + job.sizeX - 1, R);
+    int rz1 = floorDiv(job.originZ + job.sizeZ - 1, R);
+    const int regionsX = rx1 - rx0 + 1;
+    const int regionCount = regionsX * (rz1 - rz0 + 1);
+    std::atomic<int> next(0);
+    std::atomic<int> failed(0);
+    std::vector<std::thread> workers;
+    for (unsigned int t = 0; t < job.threads; t++) {
+        workers.push_back(std::thread([&, t]() {
+            Trace::instance().nameThread("worker " + std::to_string(t));
+            Terrain local = terrain;
+            RegionStore store(job.out, job.seed, job.width, codec);
+            Arena scratch;
+            Chunk chunk;
+            for (int i = next++; i < regionCount; i = next++) {
+                int rx = rx0 + i % regionsX;
+                int rz = rz0 + i / regionsX;
+                TraceScope regionScope("export region", "rx", rx, "rz", rz);
+                for (int cz = std::max(rz * R, job.originZ); cz < std::min((rz + 1) * R, job.originZ + job.sizeZ); cz++) {
+                    for (int cx = std::max(rx * R, job.originX); cx < std::min((rx + 1) * R, job.originX + job.sizeX); cx++) {
+                        {
+                            TraceScope scope("generate chunk", "cx", cx, "cz", cz);
+                            local.genChunk(cx, cz, scratch, chunk);
+                            scratch.reset();
+                        }
+                        TraceScope scope("save chunk", "cx", cx, "cz", cz);
+                        if (!store.save(cx, cz, chunk)) {
+                            ++failed;
+                        }
+                    }
+                }
+            }
+        }));
+    }
+    for (size_t t = 0; t < workers.size(); t++) {
+        workers[t].join();
+    }
+    return failed;
+}
+
+// writes the heights as a binary PGM whose white is the highest block, or as raw little endian 16 bit values
+static bool writeHeightmap(const ExportJob &job, const std::vector<std::uint16_t> &heights) {
+    std::ofstream file(job.out.c_str(), std::ios::binary);
+    if (!file) {
+        return false;
+    }
+    int w = job.sizeX * Terrain::CHUNK_SIZE;
+    int h = job.sizeZ * Terrain::CHUNK_SIZE;
+    if (job.format == "pgm") {
+        file << "P5\n" << w << " " << h << "\n" << Terrain::MAX_HEIGHT << "\n";
+        std::vector<unsigned char> row(w);
+        for (int z = 0; z < h; z++) {
+            for (int x = 0; x < w; x++) {
+                row[x] = (unsigned char)heights[(size_t)z * w + x];
+            }
+            file.write((const char*)row.data(), row.size());
+        }
+    } else {
+        std::vector<unsigned char> bytes(heights.size() * 2);
+        for (size_t i = 0; i < heights.size(); i++) {
+            bytes[2 * i] = heights[i] & 0xff;
+            bytes[2 * i + 1] = heights[i] >> 8;
+        }
+        file.write((const char*)bytes.data(), bytes.size());
+    }
+    return (bool)file;
+}
+
+int main(int argc, char** argv) {
+    ExportJob job;
+    for (int i = 1; i < argc; i++) {
+        std::string arg(argv[i]);
+        if (arg == "--width" && i + 1 < argc) {
+            job.width = std::stoi(argv[++i]);
+        } else if (arg == "--seed" && i + 1 < argc) {
+            job.seed = std::stoi(argv[++i]);
+        } else if (arg == "--origin" && i + 2 < argc) {
+            job.originX = std::stoi(argv[++i]);
+            job.originZ = std::stoi(argv[++i]);
+        } else if (arg == "--size" && i + 2 < argc) {
+            job.sizeX = std::stoi(argv[++i]);
+            job.sizeZ = std::stoi(argv[++i]);
+        } else if (arg == "--threads" && i + 1 < argc) {
+            job.threads = std::stoi(argv[++i]);
+        } else if (arg == "--format" && i + 1 < argc) {
+            job.format = argv[++i];
+        } else if (arg == "--codec" && i + 1 < argc) {
+            job.codecName = argv[++i];
+        } else if (arg == "--trace" && i + 1 < argc) {
+            job.trace = argv[++i];
+        } else if (job.out.empty() && arg[0] != '-') {
+            job.out = arg;
+        } else {
+            usage();
+            return -1;
+        }
+    }
+    if (job.out.empty() || job.sizeX <= 0 || job.sizeZ <= 0
+            || (job.format != "pgm" && job.format != "raw" && job.format != "region")) {
+        usage();
+        return -1;
+    }
+    if (job.threads == 0) {
+        job.threads = std::thread::hardware_concurrency();
+        if (job.threads == 0) {
+            job.threads = 1;
+        }
+    }
+    const Codec *codec = findCodec(job.codecName);
+    if (codec == nullptr) {
+        std::cout << "Unknown codec " << job.codecName << std::endl;
+        return -1;
+    }
+
+    if (!job.trace.empty()) {
+        Trace::instance().start(job.trace);
+        Trace::instance().nameThread("main");
+    }
+
+    // same terrain as the viewer shows with the same width and seed
+    Terrain terrain(job.width, job.seed);
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    if (job.format == "region") {
+        int failed = exportRegions(job, terrain, codec);
+        if (failed != 0) {
+            std::cout << "Failed to write " << failed << " chunks to " << job.out << std::endl;
+            return -1;
+        }
+    } else {
+        std::vector<std::uint16_t> heights;
+        exportHeights(job, terrain, heights);
+        TraceScope scope("write heightmap");
+        if (!writeHeightmap(job, heights)) {
+            std::cout << "Failed to write " << job.out << std::endl;
+            return -1;
+        }
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    int chunks = job.sizeX * job.sizeZ;
+    std::cout << chunks << " chunks on " << job.threads << " threads in " << seconds << " s, "
+              << chunks / seconds << " chunks/s" << std::endl;
+    return Trace::instance().stop() ? 0 : -1;
+}
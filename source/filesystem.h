@@ -3,7 +3,7 @@
 
 #include <string>
 #include <cstdlib>
-#include "../build/configuration/root_directory.h" // This is a configuration file generated by CMake.
+#include <configuration/root_directory.h> // This is a configuration file generated by CMake.
 
 // helper class from LearnOpenGL
 class FileSystem
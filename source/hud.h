@@ -0,0 +1,253 @@
+#ifndef HUD_H
+#define HUD_H
+
+#include <glad/glad.h>
+#include <includes/glm/glm.hpp>
+#include <shader.h>
+#include <memorytracker.h>
+
+#include <vector>
+
+// class to draw an overlay of text and bars in screen pixels with a baked 5x7 bitmap font.
+// everything queued in a frame is drawn with one draw call of its own shader
+class Hud {
+private:
+    // cells of the font texture, a glyph uses the top left 5x7 pixels of its cell
+    static const int CELL_WIDTH = 6;
+    static const int CELL_HEIGHT = 8;
+    // printable ASCII from space to underscore, lower case is drawn as upper case
+    static const int FIRST_CHAR = 32;
+    static const int GLYPHS = 64;
+    // a fully covered cell after the glyphs, for bars
+    static const int SOLID = GLYPHS;
+    static const int ATLAS_WIDTH = (GLYPHS + 1) * CELL_WIDTH;
+    static const int FLOATS_PER_VERTEX = 8;
+    static const size_t MAX_QUADS = 4096;
+
+    Shader shader;
+    unsigned int VAO = 0, VBO = 0, font = 0;
+    int screenLoc;
+    std::vector<float> vertices;
+
+    // returns the rows of a glyph from top to bottom, the high bit of the 5 is the left column
+    static const unsigned char *glyph(int index) {
+        static const unsigned char ROWS[GLYPHS][7] = {
+            { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 }, // space
+            { 0x04, 0x04, 0x04, 0x04, 0x04, 0x00, 0x04 }, // !
+            { 0x0a, 0x0a, 0x0a, 0x00, 0x00, 0x00, 0x00 }, // "
+            { 0x0a, 0x0a, 0x1f, 0x0a, 0x1f, 0x0a, 0x0a }, // #
+            { 0x04, 0x0f, 0x14, 0x0e, 0x05, 0x1e, 0x04 }, // $
+            { 0x18, 0x19, 0x02, 0x04, 0x08, 0x13, 0x03 }, // %
+            { 0x0c, 0x12, 0x14, 0x08, 0x15, 0x12, 0x0d }, // &
+            { 0x0c, 0x04, 0x08, 0x00, 0x00, 0x00, 0x00 }, // '
+            { 0x02, 0x04, 0x08, 0x08, 0x08, 0x04, 0x02 }, // (
+            { 0x08, 0x04, 0x02, 0x02, 0x02, 0x04, 0x08 }, // )
+            { 0x00, 0x04, 0x15, 0x0e, 0x15, 0x04, 0x00 }, // *
+            { 0x00, 0x04, 0x04, 0x1f, 0x04, 0x04, 0x00 }, // +
+            { 0x00, 0x00, 0x00, 0x00, 0x0c, 0x04, 0x08 }, // ,
+            { 0x00, 0x00, 0x00, 0x1f, 0x00, 0x00, 0x00 }, // -
+            { 0x00, 0x00, 0x00, 0x00, 0x00, 0x0c, 0x0c }, // .
+            { 0x00, 0x01, 0x02, 0x04, 0x08, 0x10, 0x00 }, // /
+            { 0x0e, 0x11, 0x13, 0x15, 0x19, 0x11, 0x0e }, // 0
+            { 0x04, 0x0c, 0x04, 0x04, 0x04, 0x04, 0x0e }, // 1
+            { 0x0e, 0x11, 0x01, 0x02, 0x04, 0x08, 0x1f }, // 2
+            { 0x1f, 0x02, 0x04, 0x02, 0x01, 0x11, 0x0e }, // 3
+            { 0x02, 0x06, 0x0a, 0x12, 0x1f, 0x02, 0x02 }, // 4
+            { 0x1f, 0x10, 0x1e, 0x01, 0x01, 0x11, 0x0e }, // 5
+            { 0x06, 0x08, 0x10, 0x1e, 0x11, 0x11, 0x0e }, // 6
+            { 0x1f, 0x01, 0x02, 0x04, 0x08, 0x08, 0x08 }, // 7
+            { 0x0e, 0x11, 0x11, 0x0e, 0x11, 0x11, 0x0e }, // 8
+            { 0x0e, 0x11, 0x11, 0x0f, 0x01, 0x02, 0x0c }, // 9
+            { 0x00, 0x0c, 0x0c, 0x00, 0x0c, 0x0c, 0x00 }, // :
+            { 0x00, 0x0c, 0x0c, 0x00, 0x0c, 0x04, 0x08 }, // ;
+            { 0x02, 0x04, 0x08, 0x10, 0x08, 0x04, 0x02 }, // <
+            { 0x00, 0x00, 0x1f, 0x00, 0x1f, 0x00, 0x00 }, // =
+            { 0x08, 0x04, 0x02, 0x01, 0x02, 0x04, 0x08 }, // >
+            { 0x0e, 0x11, 0x01, 0x02, 0x04, 0x00, 0x04 }, // ?
+            { 0x0e, 0x11, 0x01, 0x0d, 0x15, 0x15, 0x0e }, // @
+            { 0x0e, 0x11, 0x11, 0x11, 0x1f, 0x11, 0x11 }, // A
+            { 0x1e, 0x11, 0x11, 0x1e, 0x11, 0x11, 0x1e }, // B
+            { 0x0e, 0x11, 0x10, 0x10, 0x10, 0x11, 0x0e }, // C
+            { 0x1c, 0x12, 0x11, 0x11, 0x11, 0x12, 0x1c }, // D
+            { 0x1f, 0x10, 0x10, 0x1e, 0x10, 0x10, 0x1f }, // E
+            { 0x1f, 0x10, 0x10, 0x1e, 0x10, 0x10, 0x10 }, // F
+            { 0x0e, 0x11, 0x10, 0x17, 0x11, 0x11, 0x0f }, // G
+            { 0x11, 0x11, 0x11, 0x1f, 0x11, 0x11, 0x11 }, // H
+            { 0x0e, 0x04, 0x04, 0x04, 0x04, 0x04, 0x0e }, // I
+            { 0x07, 0x02, 0x02, 0x02, 0x02, 0x12, 0x0c }, // J
+            { 0x11, 0x12, 0x14, 0x18, 0x14, 0x12, 0x11 }, // K
+            { 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x1f }, // L
+            { 0x11, 0x1b, 0x15, 0x15, 0x11, 0x11, 0x11 }, // M
+            { 0x11, 0x11, 0x19, 0x15, 0x13, 0x11, 0x11 }, // N
+            { 0x0e, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0e }, // O
+            { 0x1e, 0x11, 0x11, 0x1e, 0x10, 0x10, 0x10 }, // P
+            { 0x0e, 0x11, 0x11, 0x11, 0x15, 0x12, 0x0d }, // Q
+            { 0x1e, 0x11, 0x11, 0x1e, 0x14, 0x12, 0x11 }, // R
+            { 0x0f, 0x10, 0x10, 0x0e, 0x01, 0x01, 0x1e }, // S
+            { 0x1f, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04 }, // T
+            { 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0e }, // U
+            { 0x11, 0x11, 0x11, 0x11, 0x11, 0x0a, 0x04 }, // V
+            { 0x11, 0x11, 0x11, 0x15, 0x15, 0x15, 0x0a }, // W
+            { 0x11, 0x11, 0x0a, 0x04, 0x0a, 0x11, 0x11 }, // X
+            { 0x11, 0x11, 0x11, 0x0a, 0x04, 0x04, 0x04 }, // Y
+            { 0x1f, 0x01, 0x02, 0x04, 0x08, 0x10, 0x1f }, // Z
+            { 0x0e, 0x08, 0x08, 0x08, 0x08, 0x08, 0x0e }, // [
+            { 0x00, 0x10, 0x08, 0x04, 0x02, 0x01, 0x00 }, // backslash
+            { 0x0e, 0x02, 0x02, 0x02, 0x02, 0x02, 0x0e }, // ]
+            { 0x04, 0x0a, 0x11, 0x00, 0x00, 0x00, 0x00 }, // ^
+            { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x1f }, // _
+        };
+        return ROWS[index];
+    }
+
+    void vertex(float x, float y, float u, float v, glm::vec4 color) {
+        float data[FLOATS_PER_VERTEX] = { x, y, u, v, color.r, color.g, color.b, color.a };
+        vertices.insert(vertices.end(), data, data + FLOATS_PER_VERTEX);
+    }
+
+    // queues a quad of pixels x0, y0 to x1, y1 showing the texels u0, v0 to u1, v1 of the font.
+    // pixel y grows down, so going down first is counter-clockwise on screen and survives culling
+    void quad(float x0, float y0, float x1, float y1, float u0, float v0, float u1, float v1, glm::vec4 color) {
+        if (vertices.size() + 6 * FLOATS_PER_VERTEX > vertices.capacity()) {
+            return;
+        }
+        vertex(x0, y0, u0, v0, color);
+        vertex(x0, y1, u0, v1, color);
+        vertex(x1, y1, u1, v1, color);
+        vertex(x1, y1, u1, v1, color);
+        vertex(x1, y0, u1, v0, color);
+        vertex(x0, y0, u0, v0, color);
+    }
+
+public:
+    // pixels per font pixel
+    static const int SCALE = 2;
+    static const int ADVANCE = CELL_WIDTH * SCALE;
+    static const int LINE_HEIGHT = (CELL_HEIGHT + 2) * SCALE;
+
+    // compiles the shader and bakes the font texture, needs a current context
+    Hud(const char *vertexPath, const char *fragmentPath):shader(vertexPath, fragmentPath) {
+        vertices.reserve(MAX_QUADS * 6 * FLOATS_PER_VERTEX);
+
+        std::vector<unsigned char> atlas(ATLAS_WIDTH * CELL_HEIGHT, 0);
+        for (int g = 0; g < GLYPHS; g++) {
+            const unsigned char *rows = glyph(g);
+            for (int y = 0; y < 7; y++) {
+                for (int x = 0; x < 5; x++) {
+                    if (rows[y] & (0x10 >> x)) {
+                        atlas[y * ATLAS_WIDTH + g * CELL_WIDTH + x] = 255;
+                    }
+                }
+            }
+        }
+        for (int y = 0; y < CELL_HEIGHT; y++) {
+            for (int x = 0; x < CELL_WIDTH; x++) {
+                atlas[y * ATLAS_WIDTH + SOLID * CELL_WIDTH + x] = 255;
+            }
+        }
+        glGenTextures(1, &font);
+        glBindTexture(GL_TEXTURE_2D, font);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, ATLAS_WIDTH, CELL_HEIGHT, 0, GL_RED, GL_UNSIGNED_BYTE, atlas.data());
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        MemoryTracker::instance().add(mem_textures, ATLAS_WIDTH * CELL_HEIGHT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+        glGenVertexArrays(1, &VAO);
+        glGenBuffers(1, &VBO);
+        glBindVertexArray(VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        glBufferData(GL_ARRAY_BUFFER, vertices.capacity() * sizeof(float), NULL, GL_STREAM_DRAW);
+        MemoryTracker::instance().add(mem_gpu_buffers, vertices.capacity() * sizeof(float));
+        GLsizei stride = FLOATS_PER_VERTEX * sizeof(float);
+        glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, stride, (void*)0);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, stride, (void*)(2 * sizeof(float)));
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, stride, (void*)(4 * sizeof(float)));
+        glEnableVertexAttribArray(2);
+
+        shader.use();
+        shader.setInt("font", 0);
+        screenLoc = glGetUniformLocation(shader.ID, "screen");
+    }
+
+    Hud(const Hud&) = delete;
+    Hud &operator=(const Hud&) = delete;
+
+    // queues a line of text with its top left corner at x, y
+    void text(float x, float y, const char *text, glm::vec4 color) {
+        for (const char *c = text; *c; c++, x += ADVANCE) {
+            int code = *c >= 'a' && *c <= 'z' ? *c - 'a' + 'A' : *c;
+            int index = code - FIRST_CHAR;
+            if (index <= 0 || index >= GLYPHS) {
+                continue;
+            }
+            float u0 = (float)(index * CELL_WIDTH) / ATLAS_WIDTH;
+            float u1 = (float)(index * CELL_WIDTH + CELL_WIDTH) / ATLAS_WIDTH;
+            quad(x, y, x + ADVANCE, y + CELL_HEIGHT * SCALE, u0, 0.0f, u1, 1.0f, color);
+        }
+    }
+
+    // queues a filled rectangle
+    void rect(float x, float y, float width, float height, glm::vec4 color) {
+        // the center of the solid cell, every fragment samples full coverage
+        float u = (SOLID * CELL_WIDTH + CELL_WIDTH * 0.5f) / ATLAS_WIDTH;
+        quad(x, y, x + width, y + height, u, 0.5f, u, 0.5f, color);
+    }
+
+    // queues a bar graph of count values starting at first in a ring of the given size,
+    // bars are scaled so maxValue fills the height
+    void graph(float x, float y, float width, float height, const float *values, size_t size, size_t first,
+            float maxValue, glm::vec4 color) {
+        rect(x, y, width, height, glm::vec4(0.0f, 0.0f, 0.0f, 0.4f));
+        float barWidth = width / size;
+        for (size_t i = 0; i < size; i++) {
+            float value = values[(first + i) % size];
+            float barHeight = value >= maxValue ? height : height * value / maxValue;
+            rect(x + i * barWidth, y + height - barHeight, barWidth, barHeight, color);
+        }
+    }
+
+    // draws everything queued this frame on top of the frame, then clears the queue.
+    // leaves its program, VAO and texture bound and depth testing enabled
+    void draw(int screenWidth, int screenHeight) {
+        if (vertices.empty()) {
+            return;
+        }
+        glDisable(GL_DEPTH_TEST);
+        glEnable(GL_BLEND);
+        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        shader.use();
+        glUniform2f(screenLoc, (float)screenWidth, (float)screenHeight);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, font);
+        glBindVertexArray(VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, vertices.size() * sizeof(float), vertices.data());
+        glDrawArrays(GL_TRIANGLES, 0, vertices.size() / FLOATS_PER_VERTEX);
+        glDisable(GL_BLEND);
+        glEnable(GL_DEPTH_TEST);
+        vertices.clear();
+    }
+
+    // returns the bytes of the font texture and vertex buffer
+    size_t gpuMemory() {
+        return ATLAS_WIDTH * CELL_HEIGHT + vertices.capacity() * sizeof(float);
+    }
+
+    // deletes the GL objects while the context is still current
+    void destroy() {
+        glDeleteVertexArrays(1, &VAO);
+        glDeleteBuffers(1, &VBO);
+        glDeleteTextures(1, &font);
+        glDeleteProgram(shader.ID);
+        MemoryTracker::instance().remove(mem_textures, ATLAS_WIDTH * CELL_HEIGHT);
+        MemoryTracker::instance().remove(mem_gpu_buffers, vertices.capacity() * sizeof(float));
+    }
+};
+
+#endif
@@ -0,0 +1,111 @@
+#ifndef IMAGE_H
+#define IMAGE_H
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// appends a big endian 32 bit value
+inline void putU32BE(std::vector<unsigned char> &out, std::uint32_t value) {
+    out.push_back(value >> 24);
+    out.push_back(value >> 16);
+    out.push_back(value >> 8);
+    out.push_back(value);
+}
+
+// returns the CRC-32 PNG chunks are checked with
+inline std::uint32_t crc32(const unsigned char *data, size_t size) {
+    static std::uint32_t table[256];
+    static bool tableReady = false;
+    if (!tableReady) {
+        for (std::uint32_t n = 0; n < 256; n++) {
+            std::uint32_t c = n;
+            for (int k = 0; k < 8; k++) {
+                c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+            }
+            table[n] = c;
+        }
+        tableReady = true;
+    }
+    std::uint32_t crc = 0xffffffffu;
+    for (size_t i = 0; i < size; i++) {
+        crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+    }
+    return crc ^ 0xffffffffu;
+}
+
+// appends a PNG chunk of the given type
+inline void putPngChunk(std::vector<unsigned char> &out, const char *type, const std::vector<unsigned char> &data) {
+    putU32BE(out, data.size());
+    size_t start = out.size();
+    out.insert(out.end(), type, type + 4);
+    out.insert(out.end(), data.begin(), data.end());
+    putU32BE(out, crc32(&out[start], out.size() - start));
+}
+
+// writes 8 bit RGBA pixels, rows from top to bottom, as a PNG. the image data is stored
+// in uncompressed deflate blocks, the files are large but need no zlib
+// @return false if the file couldn't be written
+inline bool writePng(const std::string &path, const unsigned char *rgba, int width, int height) {
+    // every row starts with filter type 0, none
+    std::vector<unsigned char> raw;
+    size_t rowBytes = (size_t)width * 4;
+    raw.reserve((rowBytes + 1) * height);
+    for (int y = 0; y < height; y++) {
+        raw.push_back(0);
+        raw.insert(raw.end(), rgba + y * rowBytes, rgba + (y + 1) * rowBytes);
+    }
+
+    std::vector<unsigned char> header;
+    putU32BE(header, width);
+    putU32BE(header, height);
+    // 8 bits per channel, truecolor with alpha, deflate, default filtering, no interlace
+    header.push_back(8);
+    header.push_back(6);
+    header.push_back(0);
+    header.push_back(0);
+    header.push_back(0);
+
+    std::vector<unsigned char> zlib;
+    zlib.push_back(0x78);
+    zlib.push_back(0x01);
+    size_t offset = 0;
+    do {
+        size_t block = raw.size() - offset < 65535 ? raw.size() - offset : 65535;
+        zlib.push_back(offset + block == raw.size() ? 1 : 0);
+        zlib.push_back(block & 0xff);
+        zlib.push_back(block >> 8);
+        zlib.push_back(~block & 0xff);
+        zlib.push_back((~block >> 8) & 0xff);
+        zlib.insert(zlib.end(), raw.begin() + offset, raw.begin() + offset + block);
+        offset += block;
+    } while (offset < raw.size());
+    std::uint32_t a = 1, b = 0;
+    for (size_t i = 0; i < raw.size(); i++) {
+        a = (a + raw[i]) % 65521;
+        b = (b + a) % 65521;
+    }
+    putU32BE(zlib, (b << 16) | a);
+
+    static const unsigned char SIGNATURE[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+    std::vector<unsigned char> png(SIGNATURE, SIGNATURE + 8);
+    putPngChunk(png, "IHDR", header);
+    putPngChunk(png, "IDAT", zlib);
+    putPngChunk(png, "IEND", std::vector<unsigned char>());
+
+    std::ofstream file(path.c_str(), std::ios::binary);
+    file.write((const char*)png.data(), png.size());
+    return (bool)file;
+}
+
+// returns the 64 bit FNV-1a hash of the pixels, equal images hash the same
+inline std::uint64_t hashPixels(const unsigned char *data, size_t size) {
+    std::uint64_t hash = 14695981039346656037ull;
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ data[i]) * 1099511628211ull;
+    }
+    return hash;
+}
+
+#endif
@@ -0,0 +1,140 @@
+#ifndef MEMORYTRACKER_H
+#define MEMORYTRACKER_H
+
+#include <atomic>
+#include <cstddef>
+#include <iomanip>
+#include <iostream>
+#include <string>
+
+// subsystems memory is accounted to
+enum MemoryTag {
+    // decoded chunks in the hot tier of the cache and the scratch memory generating them
+    mem_terrain,
+    // block coords and draw lists built from the chunks on the CPU
+    mem_mesh,
+    // sizes passed to glBufferData
+    mem_gpu_buffers,
+    // texture images and render targets
+    mem_textures,
+    // compressed chunks in the warm tier of the cache
+    mem_caches,
+    mem_tag_count
+};
+
+// class to count the bytes every subsystem holds, with the peak reached and an optional budget.
+// subsystems add() and remove() as they allocate and free, the chunk cache evicts while the
+// tags it holds are over budget. counters are atomic since chunks are generated on any thread
+class MemoryTracker {
+private:
+    std::atomic<size_t> current[mem_tag_count];
+    std::atomic<size_t> peak[mem_tag_count];
+    std::atomic<size_t> budget[mem_tag_count];
+
+    MemoryTracker() {
+        for (int t = 0; t < mem_tag_count; t++) {
+            current[t].store(0);
+            peak[t].store(0);
+            budget[t].store(0);
+        }
+    }
+
+public:
+    static MemoryTracker &instance() {
+        static MemoryTracker tracker;
+        return tracker;
+    }
+
+    MemoryTracker(const MemoryTracker&) = delete;
+    MemoryTracker &operator=(const MemoryTracker&) = delete;
+
+    static const char *name(MemoryTag tag) {
+        switch (tag) {
+        case mem_terrain: return "terrain";
+        case mem_mesh: return "mesh";
+        case mem_gpu_buffers: return "gpu buffers";
+        case mem_textures: return "textures";
+        case mem_caches: return "caches";
+        default: return "unknown";
+        }
+    }
+
+    // returns the tag of a name as printed by name(), with _ or - for the space
+    // @return false if there is no such tag
+    static bool fromName(std::string text, MemoryTag &tag) {
+        for (size_t i = 0; i < text.size(); i++) {
+            if (text[i] == '_' || text[i] == '-') {
+                text[i] = ' ';
+            }
+        }
+        for (int t = 0; t < mem_tag_count; t++) {
+            if (text == name((MemoryTag)t)) {
+                tag = (MemoryTag)t;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void add(MemoryTag tag, size_t bytes) {
+        size_t now = current[tag].fetch_add(bytes, std::memory_order_relaxed) + bytes;
+        size_t highest = peak[tag].load(std::memory_order_relaxed);
+        while (now > highest && !peak[tag].compare_exchange_weak(highest, now, std::memory_order_relaxed)) {
+        }
+    }
+
+    void remove(MemoryTag tag, size_t bytes) {
+        current[tag].fetch_sub(bytes, std::memory_order_relaxed);
+    }
+
+    size_t getCurrent(MemoryTag tag) {
+        return current[tag].load(std::memory_order_relaxed);
+    }
+
+    size_t getPeak(MemoryTag tag) {
+        return peak[tag].load(std::memory_order_relaxed);
+    }
+
+    // returns the sum of the current bytes of every tag
+    size_t getTotal() {
+        size_t total = 0;
+        for (int t = 0; t < mem_tag_count; t++) {
+            total += getCurrent((MemoryTag)t);
+        }
+        return total;
+    }
+
+    // sets the bytes a tag should stay under, 0 for no limit
+    void setBudget(MemoryTag tag, size_t bytes) {
+        budget[tag].store(bytes, std::memory_order_relaxed);
+    }
+
+    size_t getBudget(MemoryTag tag) {
+        return budget[tag].load(std::memory_order_relaxed);
+    }
+
+    bool overBudget(MemoryTag tag) {
+        size_t limit = getBudget(tag);
+        return limit > 0 && getCurrent(tag) > limit;
+    }
+
+    // prints the current and peak MiB of every tag and the budgets set
+    void report(std::ostream &out) {
+        std::ios::fmtflags flags = out.flags();
+        std::streamsize precision = out.precision();
+        out << std::fixed << std::setprecision(1);
+        for (int t = 0; t < mem_tag_count; t++) {
+            MemoryTag tag = (MemoryTag)t;
+            out << "memory " << name(tag) << ": " << getCurrent(tag) / 1048576.0 << " MiB, peak "
+                << getPeak(tag) / 1048576.0 << " MiB";
+            if (getBudget(tag) > 0) {
+                out << ", budget " << getBudget(tag) / 1048576.0 << " MiB";
+            }
+            out << std::endl;
+        }
+        out.flags(flags);
+        out.precision(precision);
+    }
+};
+
+#endif
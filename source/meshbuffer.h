@@ -0,0 +1,284 @@
+#ifndef MESHBUFFER_H
+#define MESHBUFFER_H
+
+#include <glad/glad.h>
+#include <mesher.h>
+#include <chunkcache.h>
+#include <world.h>
+#include <memorytracker.h>
+
+#include <cstddef>
+#include <map>
+#include <unordered_map>
+#include <vector>
+
+// first fit allocator of ranges of a buffer, freed ranges merge with their free neighbours
+class RangeAllocator {
+private:
+    size_t capacity = 0;
+    // offset -> size of every free range
+    std::map<size_t, size_t> freeRanges;
+
+public:
+    // makes the whole capacity free
+    void reset(size_t capacity) {
+        this->capacity = capacity;
+        freeRanges.clear();
+        if (capacity > 0) {
+            freeRanges[0] = capacity;
+        }
+    }
+
+    // @return false if no free range is large enough
+    bool alloc(size_t size, size_t &offset) {
+        for (std::map<size_t, size_t>::iterator it = freeRanges.begin(); it != freeRanges.end(); ++it) {
+            if (it->second < size) {
+                continue;
+            }
+            offset = it->first;
+            size_t rest = it->second - size;
+            freeRanges.erase(it);
+            if (rest > 0) {
+                freeRanges[offset + size] = rest;
+            }
+            return true;
+        }
+        return false;
+    }
+
+    void free(size_t offset, size_t size) {
+        if (size == 0) {
+            return;
+        }
+        std::map<size_t, size_t>::iterator next = freeRanges.lower_bound(offset);
+        if (next != freeRanges.end() && offset + size == next->first) {
+            size += next->second;
+            next = freeRanges.erase(next);
+        }
+        if (next != freeRanges.begin()) {
+            std::map<size_t, size_t>::iterator previous = next;
+            --previous;
+            if (previous->first + previous->second == offset) {
+                previous->second += size;
+                return;
+            }
+        }
+        freeRanges[offset] = size;
+    }
+
+    // adds room at the end, the allocated ranges stay where they are
+    void grow(size_t newCapacity) {
+        size_t oldCapacity = capacity;
+        capacity = newCapacity;
+        free(oldCapacity, newCapacity - oldCapacity);
+    }
+
+    size_t getCapacity() {
+        return capacity;
+    }
+};
+
+// where the mesh of a chunk lives in a MeshBuffer, the indices of every material and direction
+// follow each other
+struct MeshRange {
+    size_t baseVertex;
+    size_t vertexCount;
+    size_t firstIndex;
+    size_t indexCount;
+    size_t groupFirst[mesh_material_count][mesh_face_count];
+    size_t groupCount[mesh_material_count][mesh_face_count];
+    // the last sync() the chunk was loaded in
+    unsigned int seen;
+    // the revision of the mesh copied here
+    unsigned int revision;
+};
+
+// class to hold the meshes of many chunks in one vertex and one index buffer behind a single VAO,
+// so all of them can be drawn without binding anything in between. buffers grow by copying on
+// the GPU when a mesh doesn't fit
+class MeshBuffer {
+private:
+    static const size_t INITIAL_VERTICES = 1 << 18;
+    static const size_t INITIAL_INDICES = INITIAL_VERTICES * 3 / 2;
+
+    unsigned int VAO = 0, VBO = 0, IBO = 0;
+    RangeAllocator vertexSpace;
+    RangeAllocator indexSpace;
+    std::unordered_map<ChunkCache::Key, MeshRange, ChunkCache::KeyHash> ranges;
+    unsigned int syncs = 0;
+    std::vector<ChunkCache::Key> stale;
+
+    size_t gpuBytes() {
+        return vertexSpace.getCapacity() * sizeof(BlockVertex) + indexSpace.getCapacity() * sizeof(unsigned short);
+    }
+
+    void setAttributes() {
+        glBindVertexArray(VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(BlockVertex), (void*)offsetof(BlockVertex, x));
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(BlockVertex), (void*)offsetof(BlockVertex, u));
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(2, 1, GL_FLOAT, GL_FALSE, sizeof(BlockVertex), (void*)offsetof(BlockVertex, light));
+        glEnableVertexAttribArray(2);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, IBO);
+    }
+
+    // replaces buffer by one of newSize bytes holding its first oldSize bytes
+    static void growBuffer(unsigned int &buffer, size_t oldSize, size_t newSize) {
+        unsigned int grown;
+        glGenBuffers(1, &grown);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, grown);
+        glBufferData(GL_COPY_WRITE_BUFFER, newSize, NULL, GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, oldSize);
+        glDeleteBuffers(1, &buffer);
+        buffer = grown;
+    }
+
+    // doubles the space of whichever allocator can't fit size until it can. the VAO bound before
+    // is bound again after, a GlStateCache of the caller still knows what is bound
+    void grow(RangeAllocator &space, unsigned int &buffer, size_t elementSize, size_t size) {
+        GLint boundVAO = 0;
+        glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &boundVAO);
+        size_t before = gpuBytes();
+        size_t capacity = space.getCapacity();
+        size_t newCapacity = capacity;
+        size_t offset;
+        do {
+            newCapacity *= 2;
+            RangeAllocator probe = space;
+            probe.grow(newCapacity);
+            if (probe.alloc(size, offset)) {
+                break;
+            }
+        } while (true);
+        growBuffer(buffer, capacity * elementSize, newCapacity * elementSize);
+        space.grow(newCapacity);
+        setAttributes();
+        glBindVertexArray(boundVAO);
+        MemoryTracker::instance().add(mem_gpu_buffers, gpuBytes() - before);
+    }
+
+public:
+    // creates the buffers, needs a current context
+    void init() {
+        glGenVertexArrays(1, &VAO);
+        glGenBuffers(1, &VBO);
+        glGenBuffers(1, &IBO);
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        glBufferData(GL_ARRAY_BUFFER, INITIAL_VERTICES * sizeof(BlockVertex), NULL, GL_DYNAMIC_DRAW);
+        glBindVertexArray(VAO);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, IBO);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, INITIAL_INDICES * sizeof(unsigned short), NULL, GL_DYNAMIC_DRAW);
+        vertexSpace.reset(INITIAL_VERTICES);
+        indexSpace.reset(INITIAL_INDICES);
+        setAttributes();
+        glBindVertexArray(0);
+        MemoryTracker::instance().add(mem_gpu_buffers, gpuBytes());
+    }
+
+    // deletes the buffers while the context is still current
+    void destroy() {
+        MemoryTracker::instance().remove(mem_gpu_buffers, gpuBytes());
+        glDeleteVertexArrays(1, &VAO);
+        glDeleteBuffers(1, &VBO);
+        glDeleteBuffers(1, &IBO);
+        vertexSpace.reset(0);
+        indexSpace.reset(0);
+        ranges.clear();
+    }
+
+    // copies the mesh of the chunk at cx, cz into the buffers, replacing the one it had
+    void upload(int cx, int cz, const ChunkMeshData &mesh) {
+        release(cx, cz);
+        MeshRange range;
+        range.vertexCount = mesh.vertices.size();
+        range.indexCount = mesh.indexCount();
+        range.baseVertex = 0;
+        range.firstIndex = 0;
+        range.seen = syncs;
+        range.revision = mesh.revision;
+        if (range.vertexCount > 0 && !vertexSpace.alloc(range.vertexCount, range.baseVertex)) {
+            grow(vertexSpace, VBO, sizeof(BlockVertex), range.vertexCount);
+            vertexSpace.alloc(range.vertexCount, range.baseVertex);
+        }
+        if (range.indexCount > 0 && !indexSpace.alloc(range.indexCount, range.firstIndex)) {
+            grow(indexSpace, IBO, sizeof(unsigned short), range.indexCount);
+            indexSpace.alloc(range.indexCount, range.firstIndex);
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        glBufferSubData(GL_ARRAY_BUFFER, range.baseVertex * sizeof(BlockVertex),
+            range.vertexCount * sizeof(BlockVertex), mesh.vertices.data());
+        // the element buffer binding belongs to the VAO, copy through a binding point of its own
+        glBindBuffer(GL_COPY_WRITE_BUFFER, IBO);
+        size_t first = range.firstIndex;
+        for (int m = 0; m < mesh_material_count; m++) {
+            for (int f = 0; f < mesh_face_count; f++) {
+                range.groupFirst[m][f] = first;
+                range.groupCount[m][f] = mesh.indices[m][f].size();
+                if (range.groupCount[m][f] == 0) {
+                    continue;
+                }
+                glBufferSubData(GL_COPY_WRITE_BUFFER, first * sizeof(unsigned short),
+                    range.groupCount[m][f] * sizeof(unsigned short), mesh.indices[m][f].data());
+                first += range.groupCount[m][f];
+            }
+        }
+        ranges[ChunkCache::Key(cx, cz)] = range;
+    }
+
+    // frees the space of the mesh of the chunk at cx, cz if it has one
+    void release(int cx, int cz) {
+        std::unordered_map<ChunkCache::Key, MeshRange, ChunkCache::KeyHash>::iterator it = ranges.find(ChunkCache::Key(cx, cz));
+        if (it == ranges.end()) {
+            return;
+        }
+        vertexSpace.free(it->second.baseVertex, it->second.vertexCount);
+        indexSpace.free(it->second.firstIndex, it->second.indexCount);
+        ranges.erase(it);
+    }
+
+    // returns where the mesh of the chunk at cx, cz is, null if it has none
+    const MeshRange *find(int cx, int cz) {
+        std::unordered_map<ChunkCache::Key, MeshRange, ChunkCache::KeyHash>::iterator it = ranges.find(ChunkCache::Key(cx, cz));
+        return it == ranges.end() ? nullptr : &it->second;
+    }
+
+    // makes the buffers hold the meshes of exactly the loaded chunks, freeing the space of the
+    // chunks that left first so the new ones can take it. meshes built again are copied again
+    void sync(const std::vector<WorldChunk> &chunks) {
+        ++syncs;
+        for (size_t i = 0; i < chunks.size(); i++) {
+            std::unordered_map<ChunkCache::Key, MeshRange, ChunkCache::KeyHash>::iterator it = ranges.find(ChunkCache::Key(chunks[i].cx, chunks[i].cz));
+            if (it != ranges.end()) {
+                it->second.seen = syncs;
+            }
+        }
+        stale.clear();
+        for (std::unordered_map<ChunkCache::Key, MeshRange, ChunkCache::KeyHash>::iterator it = ranges.begin(); it != ranges.end(); ++it) {
+            if (it->second.seen != syncs) {
+                stale.push_back(it->first);
+            }
+        }
+        for (size_t i = 0; i < stale.size(); i++) {
+            release(stale[i].first, stale[i].second);
+        }
+        for (size_t i = 0; i < chunks.size(); i++) {
+            const MeshRange *range = find(chunks[i].cx, chunks[i].cz);
+            if (range == nullptr || range->revision != chunks[i].mesh->revision) {
+                upload(chunks[i].cx, chunks[i].cz, *chunks[i].mesh);
+            }
+        }
+    }
+
+    unsigned int getVAO() {
+        return VAO;
+    }
+
+    size_t size() {
+        return ranges.size();
+    }
+};
+
+#endif
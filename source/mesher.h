@@ -0,0 +1,352 @@
+#ifndef MESHER_H
+#define MESHER_H
+
+#include <chunk.h>
+#include <rlechunk.h>
+
+#include <atomic>
+#include <limits>
+#include <vector>
+
+// textures the faces of a chunk mesh are drawn with, the indices of a mesh are grouped by them
+enum mesh_material {
+    mesh_dirt,
+    mesh_grass_side,
+    mesh_grass_top,
+    mesh_material_count
+};
+
+// directions block faces look in, the indices of a material are grouped by them too
+enum mesh_face {
+    mesh_back,
+    mesh_front,
+    mesh_left,
+    mesh_right,
+    mesh_bottom,
+    mesh_top,
+    mesh_face_count
+};
+
+// a corner of a block face in world space, with the light left by the ambient occlusion of the
+// blocks around the corner, 1 for none
+struct BlockVertex {
+    float x, y, z;
+    float u, v;
+    float light;
+};
+
+// the faces of a chunk that can be seen, as quads of four vertices. indices are relative to the
+// first vertex of the mesh and grouped by material and direction, a chunk never has more than
+// 65536 vertices
+struct ChunkMeshData {
+    std::vector<BlockVertex> vertices;
+    std::vector<unsigned short> indices[mesh_material_count][mesh_face_count];
+    // the lowest and highest coordinate along their normal of the faces of every direction
+    float planeMin[mesh_face_count];
+    float planeMax[mesh_face_count];
+    // different for every build, so copies of the mesh (e.g. on the GPU) can tell they are stale
+    unsigned int revision = 0;
+
+    ChunkMeshData() {
+        clear();
+    }
+
+    void clear() {
+        vertices.clear();
+        for (int m = 0; m < mesh_material_count; m++) {
+            for (int f = 0; f < mesh_face_count; f++) {
+                indices[m][f].clear();
+            }
+        }
+        for (int f = 0; f < mesh_face_count; f++) {
+            planeMin[f] = std::numeric_limits<float>::max();
+            planeMax[f] = -std::numeric_limits<float>::max();
+        }
+    }
+
+    size_t indexCount() const {
+        size_t count = 0;
+        for (int m = 0; m < mesh_material_count; m++) {
+            for (int f = 0; f < mesh_face_count; f++) {
+                count += indices[m][f].size();
+            }
+        }
+        return count;
+    }
+
+    // returns true if every face looking in direction f shows its back to a camera at x, y, z,
+    // so drawing them with back faces culled draws nothing
+    bool facesAway(int f, float x, float y, float z) const {
+        // back and front look along z, left and right along x, bottom and top along y
+        float eye = f < mesh_left ? z : f < mesh_bottom ? x : y;
+        // even directions look towards -inf
+        return f % 2 == 1 ? eye <= planeMin[f] : eye >= planeMax[f];
+    }
+
+    size_t memoryUsage() const {
+        size_t bytes = sizeof(ChunkMeshData) + vertices.capacity() * sizeof(BlockVertex);
+        for (int m = 0; m < mesh_material_count; m++) {
+            for (int f = 0; f < mesh_face_count; f++) {
+                bytes += indices[m][f].capacity() * sizeof(unsigned short);
+            }
+        }
+        return bytes;
+    }
+};
+
+// a chunk and the eight chunks around it, which the mesher looks into past the sides of the chunk.
+// chunks that aren't loaded are null and count as air, so the faces towards them are kept.
+// ChunkT is Chunk or RleChunk
+template <typename ChunkT>
+struct Neighbourhood {
+    // every chunk at [dz + 1][dx + 1] relative to the one meshed, which is in the middle
+    const ChunkT *chunks[3][3];
+
+    explicit Neighbourhood(const ChunkT &center) {
+        for (int z = 0; z < 3; z++) {
+            for (int x = 0; x < 3; x++) {
+                chunks[z][x] = nullptr;
+            }
+        }
+        chunks[1][1] = &center;
+    }
+
+    const ChunkT &center() const {
+        return *chunks[1][1];
+    }
+
+    // returns true if the block at x, y, z of the middle chunk is solid, x and z may be up to a
+    // chunk outside of it
+    bool isSolid(int x, int y, int z) const {
+        if (y < 0) {
+            return false;
+        }
+        int dx = x < 0 ? -1 : x >= Chunk::SIZE ? 1 : 0;
+        int dz = z < 0 ? -1 : z >= Chunk::SIZE ? 1 : 0;
+        const ChunkT *chunk = chunks[dz + 1][dx + 1];
+        return chunk != nullptr && chunk->get(x - dx * Chunk::SIZE, y, z - dz * Chunk::SIZE) != block_air;
+    }
+
+    // returns the runs of the column at x, z of the middle chunk, which may be up to a chunk
+    // outside of it. a column of a chunk that isn't loaded has none, it is all air
+    ColumnRuns column(int x, int z) const {
+        int dx = x < 0 ? -1 : x >= Chunk::SIZE ? 1 : 0;
+        int dz = z < 0 ? -1 : z >= Chunk::SIZE ? 1 : 0;
+        const ChunkT *chunk = chunks[dz + 1][dx + 1];
+        return chunk != nullptr ? chunk->column(x - dx * Chunk::SIZE, z - dz * Chunk::SIZE) : ColumnRuns(nullptr, nullptr);
+    }
+};
+
+typedef Neighbourhood<Chunk> ChunkNeighbourhood;
+typedef Neighbourhood<RleChunk> RleNeighbourhood;
+
+// class to turn the blocks of a chunk into the faces next to air. faces towards a neighbouring
+// chunk that isn't loaded are kept, the chunk has to be meshed again once it is. every corner is
+// darkened by the blocks around it, across chunk sides too, so lighting costs the fragment shader
+// a multiply. run-length chunks are meshed a run at a time instead of a block at a time
+class ChunkMesher {
+private:
+    struct Corner {
+        float x, y, z;
+        float u, v;
+    };
+
+    struct Face {
+        int dx, dy, dz;
+        Corner corners[4];
+    };
+
+    // the faces of a unit block around its center in the order back, front, left, right, bottom, top.
+    // corners go counter-clockwise seen from outside the block, so back faces can be culled
+    static const Face &face(int f) {
+        static const Face FACES[6] = {
+            { 0, 0, -1, { { -0.5f, -0.5f, -0.5f, 0.0f, 0.0f }, { -0.5f, 0.5f, -0.5f, 0.0f, 1.0f },
+                          { 0.5f, 0.5f, -0.5f, 1.0f, 1.0f }, { 0.5f, -0.5f, -0.5f, 1.0f, 0.0f } } },
+            { 0, 0, 1, { { -0.5f, -0.5f, 0.5f, 0.0f, 0.0f }, { 0.5f, -0.5f, 0.5f, 1.0f, 0.0f },
+                         { 0.5f, 0.5f, 0.5f, 1.0f, 1.0f }, { -0.5f, 0.5f, 0.5f, 0.0f, 1.0f } } },
+            { -1, 0, 0, { { -0.5f, 0.5f, 0.5f, 1.0f, 0.0f }, { -0.5f, 0.5f, -0.5f, 1.0f, 1.0f },
+                          { -0.5f, -0.5f, -0.5f, 0.0f, 1.0f }, { -0.5f, -0.5f, 0.5f, 0.0f, 0.0f } } },
+            { 1, 0, 0, { { 0.5f, 0.5f, 0.5f, 1.0f, 0.0f }, { 0.5f, -0.5f, 0.5f, 0.0f, 0.0f },
+                         { 0.5f, -0.5f, -0.5f, 0.0f, 1.0f }, { 0.5f, 0.5f, -0.5f, 1.0f, 1.0f } } },
+            { 0, -1, 0, { { -0.5f, -0.5f, -0.5f, 0.0f, 1.0f }, { 0.5f, -0.5f, -0.5f, 1.0f, 1.0f },
+                          { 0.5f, -0.5f, 0.5f, 1.0f, 0.0f }, { -0.5f, -0.5f, 0.5f, 0.0f, 0.0f } } },
+            { 0, 1, 0, { { -0.5f, 0.5f, -0.5f, 0.0f, 1.0f }, { -0.5f, 0.5f, 0.5f, 0.0f, 0.0f },
+                         { 0.5f, 0.5f, 0.5f, 1.0f, 0.0f }, { 0.5f, 0.5f, -0.5f, 1.0f, 1.0f } } },
+        };
+        return FACES[f];
+    }
+
+    // texture coords of the corners of the back, front, left and right faces of grass, with the grass edge up
+    static const float *grassSideUv(int f, int corner) {
+        static const float UVS[4][4][2] = {
+            { { 0.0f, 0.0f }, { 0.0f, -1.0f }, { -1.0f, -1.0f }, { -1.0f, 0.0f } },
+            { { 0.0f, 0.0f }, { -1.0f, 0.0f }, { -1.0f, -1.0f }, { 0.0f, -1.0f } },
+            { { 0.0f, 0.0f }, { 1.0f, 0.0f }, { 1.0f, 1.0f }, { 0.0f, 1.0f } },
+            { { 0.0f, 0.0f }, { 0.0f, 1.0f }, { 1.0f, 1.0f }, { 1.0f, 0.0f } },
+        };
+        return UVS[f][corner];
+    }
+
+    static unsigned int nextRevision() {
+        static std::atomic<unsigned int> revisions(0);
+        return ++revisions;
+    }
+
+    // returns the ambient occlusion of a corner of the face of the block at x, y, z from 0 (darkest)
+    // to 3, by the classic rule: the two blocks next to the corner in front of the face and the one
+    // diagonal between them. with both sides solid the corner is fully dark whatever the diagonal is
+    template <typename ChunkT>
+    static int occlusion(const Neighbourhood<ChunkT> &around, int x, int y, int z, const Face &current, const Corner &corner) {
+        // the air block in front of the face and the steps from it towards the corner
+        int px = x + current.dx, py = y + current.dy, pz = z + current.dz;
+        int sx = current.dx != 0 ? 0 : corner.x > 0 ? 1 : -1;
+        int sy = current.dy != 0 ? 0 : corner.y > 0 ? 1 : -1;
+        int sz = current.dz != 0 ? 0 : corner.z > 0 ? 1 : -1;
+        bool side1 = sx != 0 ? around.isSolid(px + sx, py, pz) : around.isSolid(px, py + sy, pz);
+        bool side2 = sz != 0 ? around.isSolid(px, py, pz + sz) : around.isSolid(px, py + sy, pz);
+        bool diagonal = around.isSolid(px + sx, py + sy, pz + sz);
+        if (side1 && side2) {
+            return 0;
+        }
+        return 3 - side1 - side2 - diagonal;
+    }
+
+    // returns the light of a corner of the given ambient occlusion
+    static float light(int occlusion) {
+        static const float LIGHT[4] = { 0.45f, 0.65f, 0.82f, 1.0f };
+        return LIGHT[occlusion];
+    }
+
+    // appends face f of the block at x, y, z of the middle chunk of around to mesh, unless the
+    // mesh is full
+    template <typename ChunkT>
+    static void emitFace(const Neighbourhood<ChunkT> &around, float xStart, float zStart, int x, int y, int z,
+            int f, BlockId id, ChunkMeshData &mesh) {
+        if (mesh.vertices.size() + 4 > MAX_VERTICES) {
+            return;
+        }
+        const Face &current = face(f);
+        // grass has its own top and sides over a dirt bottom
+        int material = mesh_dirt;
+        if (id == block_grass && f < mesh_bottom) {
+            material = mesh_grass_side;
+        } else if (id == block_grass && f == mesh_top) {
+            material = mesh_grass_top;
+        }
+        unsigned short first = (unsigned short)mesh.vertices.size();
+        int ao[4];
+        for (int c = 0; c < 4; c++) {
+            const Corner &corner = current.corners[c];
+            BlockVertex vertex;
+            vertex.x = xStart + x + corner.x;
+            vertex.y = y + corner.y;
+            vertex.z = zStart + z + corner.z;
+            vertex.u = material == mesh_grass_side ? grassSideUv(f, c)[0] : corner.u;
+            vertex.v = material == mesh_grass_side ? grassSideUv(f, c)[1] : corner.v;
+            ao[c] = occlusion(around, x, y, z, current, corner);
+            vertex.light = light(ao[c]);
+            mesh.vertices.push_back(vertex);
+        }
+        // the light is interpolated across each triangle, so split the quad along the darker
+        // diagonal or the shading depends on the way the quad happens to be split.
+        // both splits keep the corners counter-clockwise
+        static const unsigned short QUAD[6] = { 0, 1, 2, 2, 3, 0 };
+        static const unsigned short FLIPPED[6] = { 1, 2, 3, 3, 0, 1 };
+        const unsigned short *split = ao[0] + ao[2] > ao[1] + ao[3] ? FLIPPED : QUAD;
+        for (int i = 0; i < 6; i++) {
+            mesh.indices[material][f].push_back(first + split[i]);
+        }
+        // every corner of the face has the same coordinate along its normal
+        const BlockVertex &corner = mesh.vertices[first];
+        float plane = f < mesh_left ? corner.z : f < mesh_bottom ? corner.x : corner.y;
+        if (plane < mesh.planeMin[f]) {
+            mesh.planeMin[f] = plane;
+        }
+        if (plane > mesh.planeMax[f]) {
+            mesh.planeMax[f] = plane;
+        }
+    }
+
+    // calls fn(y) for every height from bottom to top (exclusive) where a column is air
+    template <typename Fn>
+    static void forEachAir(ColumnRuns column, int bottom, int top, Fn fn) {
+        int y = bottom;
+        for (RunIterator it = column.begin(); it != column.end() && y < top; ++it) {
+            if (it.top() <= y) {
+                continue;
+            }
+            int end = it.top() < top ? it.top() : top;
+            if (it->id == block_air) {
+                for (; y < end; y++) {
+                    fn(y);
+                }
+            }
+            y = end;
+        }
+        // air above the last run is implicit
+        for (; y < top; y++) {
+            fn(y);
+        }
+    }
+
+public:
+    // vertices 16 bit indices can address, faces past it are dropped
+    static const size_t MAX_VERTICES = 65536;
+
+    // writes the visible faces of the chunk at cx, cz in the middle of around in world space to mesh
+    static void build(const ChunkNeighbourhood &around, int cx, int cz, ChunkMeshData &mesh) {
+        mesh.clear();
+        mesh.revision = nextRevision();
+        float xStart = (float)(cx * Chunk::SIZE);
+        float zStart = (float)(cz * Chunk::SIZE);
+        around.center().forEachSolid([&](int x, int y, int z, BlockId id) {
+            for (int f = 0; f < mesh_face_count; f++) {
+                const Face &current = face(f);
+                if (!around.isSolid(x + current.dx, y + current.dy, z + current.dz)) {
+                    emitFace(around, xStart, zStart, x, y, z, f, id, mesh);
+                }
+            }
+        });
+    }
+
+    // writes the visible faces of the run-length chunk at cx, cz in the middle of around in world
+    // space to mesh, the same faces the block by block build writes for the same blocks. the blocks
+    // of a run hide the tops and bottoms of each other, so only the ends of a run are checked, and
+    // its sides are found by walking the runs of the columns next to it
+    static void build(const RleNeighbourhood &around, int cx, int cz, ChunkMeshData &mesh) {
+        mesh.clear();
+        mesh.revision = nextRevision();
+        float xStart = (float)(cx * Chunk::SIZE);
+        float zStart = (float)(cz * Chunk::SIZE);
+        for (int z = 0; z < Chunk::SIZE; z++) {
+            for (int x = 0; x < Chunk::SIZE; x++) {
+                ColumnRuns column = around.center().column(x, z);
+                for (RunIterator run = column.begin(); run != column.end(); ++run) {
+                    BlockId id = run->id;
+                    if (id == block_air) {
+                        continue;
+                    }
+                    if (!around.isSolid(x, run.bottom() - 1, z)) {
+                        emitFace(around, xStart, zStart, x, run.bottom(), z, mesh_bottom, id, mesh);
+                    }
+                    if (!around.isSolid(x, run.top(), z)) {
+                        emitFace(around, xStart, zStart, x, run.top() - 1, z, mesh_top, id, mesh);
+                    }
+                    for (int f = 0; f < mesh_bottom; f++) {
+                        const Face &current = face(f);
+                        forEachAir(around.column(x + current.dx, z + current.dz), run.bottom(), run.top(), [&](int y) {
+                            emitFace(around, xStart, zStart, x, y, z, f, id, mesh);
+                        });
+                    }
+                }
+            }
+        }
+    }
+
+    // writes the visible faces of a chunk without neighbours in world space to mesh
+    static void build(const Chunk &chunk, int cx, int cz, ChunkMeshData &mesh) {
+        build(ChunkNeighbourhood(chunk), cx, cz, mesh);
+    }
+};
+
+#endif
@@ -0,0 +1,292 @@
+#ifndef OCTREE_H
+#define OCTREE_H
+
+#include <includes/glm/glm.hpp>
+#include <chunk.h>
+#include <trace.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <future>
+#include <vector>
+
+// a cube of blocks extracted at some level of detail
+struct LodCell {
+    int x;
+    int y;
+    int z;
+    int size;
+    BlockId id;
+};
+
+// result of a ray cast, the block hit and the distance along the ray to it
+struct RayHit {
+    glm::ivec3 block;
+    BlockId id;
+    float distance;
+};
+
+// class to store a cube of blocks as a sparse voxel octree. every region made of a single block
+// type collapses into one leaf, so the large stretches of air and solid ground of heightfield
+// terrain cost a few nodes instead of a dense array
+class SparseVoxelOctree {
+private:
+    // children is the index of the first of 8 consecutive children, 0 for leaves.
+    // id is the block type of a leaf or the representative type of an inner node for lods
+    struct Node {
+        std::uint32_t children;
+        BlockId id;
+    };
+
+    std::vector<Node> nodes;
+    glm::ivec3 origin;
+    int depth = 0;
+
+    // the chunks the octree is built from, laid out side x side starting at origin
+    struct Source {
+        const std::vector<const Chunk*> *chunks;
+        int side;
+    };
+
+    static BlockId sourceGet(const Source &source, int x, int y, int z) {
+        int cx = x / Chunk::SIZE;
+        int cz = z / Chunk::SIZE;
+        if (cx >= source.side || cz >= source.side || y >= Chunk::HEIGHT) {
+            return block_air;
+        }
+        const Chunk *chunk = (*source.chunks)[cz * source.side + cx];
+        if (chunk == nullptr) {
+            return block_air;
+        }
+        return chunk->get(x % Chunk::SIZE, y, z % Chunk::SIZE);
+    }
+
+    // returns the section covering a 16 block cube if that cube is a single block type
+    static bool sourceUniform(const Source &source, int x, int y, int z, BlockId &id) {
+        int cx = x / Chunk::SIZE;
+        int cz = z / Chunk::SIZE;
+        if (cx >= source.side || cz >= source.side || y >= Chunk::HEIGHT) {
+            id = block_air;
+            return true;
+        }
+        const Chunk *chunk = (*source.chunks)[cz * source.side + cx];
+        if (chunk == nullptr) {
+            id = block_air;
+            return true;
+        }
+        const ChunkSection &section = chunk->section(y / ChunkSection::SIZE);
+        id = section.uniformId();
+        return section.isUniform();
+    }
+
+    // builds the node covering the cube at x, y, z of the given size into nodes[index]
+    void build(const Source &source, std::uint32_t index, int x, int y, int z, int size) {
+        BlockId id;
+        if (size == 1) {
+            nodes[index].children = 0;
+            nodes[index].id = sourceGet(source, x, y, z);
+            return;
+        }
+        if ((size == ChunkSection::SIZE || y >= Chunk::HEIGHT || x >= source.side * Chunk::SIZE
+                || z >= source.side * Chunk::SIZE) && sourceUniform(source, x, y, z, id)) {
+            nodes[index].children = 0;
+            nodes[index].id = id;
+            return;
+        }
+
+        std::uint32_t first = nodes.size();
+        nodes.resize(first + 8);
+        int half = size / 2;
+        for (int i = 0; i < 8; i++) {
+            build(source, first + i, x + (i & 1) * half, y + ((i >> 1) & 1) * half, z + ((i >> 2) & 1) * half, half);
+        }
+
+        // collapse children that are all the same leaf, they were the last nodes added
+        bool uniform = nodes[first].children == 0;
+        for (int i = 1; i < 8 && uniform; i++) {
+            uniform = nodes[first + i].children == 0 && nodes[first + i].id == nodes[first].id;
+        }
+        if (uniform) {
+            nodes[index].children = 0;
+            nodes[index].id = nodes[first].id;
+            nodes.resize(first);
+            return;
+        }
+        nodes[index].children = first;
+        nodes[index].id = representative(first);
+    }
+
+    // returns the most common solid type among the children, so coarse lods keep their silhouette
+    BlockId representative(std::uint32_t first) {
+        BlockId best = block_air;
+        int bestCount = 0;
+        for (int i = 0; i < 8; i++) {
+            BlockId id = nodes[first + i].id;
+            if (id == block_air) {
+                continue;
+            }
+            int count = 0;
+            for (int j = 0; j < 8; j++) {
+                count += nodes[first + j].id == id;
+            }
+            if (count > bestCount) {
+                best = id;
+                bestCount = count;
+            }
+        }
+        return best;
+    }
+
+    // finds the leaf containing the local coords, returning its corner and size
+    const Node &findLeaf(int x, int y, int z, glm::ivec3 &corner, int &size) const {
+        std::uint32_t index = 0;
+        corner = glm::ivec3(0);
+        size = 1 << depth;
+        while (nodes[index].children != 0) {
+            size /= 2;
+            int i = (x >= corner.x + size) | ((y >= corner.y + size) << 1) | ((z >= corner.z + size) << 2);
+            corner += glm::ivec3(i & 1, (i >> 1) & 1, (i >> 2) & 1) * size;
+            index = nodes[index].children + i;
+        }
+        return nodes[index];
+    }
+
+    void extract(std::uint32_t index, int x, int y, int z, int size, int cellSize, std::vector<LodCell> &cells) const {
+        const Node &node = nodes[index];
+        if (node.children == 0 || size <= cellSize) {
+            if (node.id != block_air) {
+                LodCell cell = { origin.x + x, origin.y + y, origin.z + z, size, node.id };
+                cells.push_back(cell);
+            }
+            return;
+        }
+        int half = size / 2;
+        for (int i = 0; i < 8; i++) {
+            extract(node.children + i, x + (i & 1) * half, y + ((i >> 1) & 1) * half, z + ((i >> 2) & 1) * half, half, cellSize, cells);
+        }
+    }
+
+public:
+    // builds the octree of side x side chunks whose first chunk starts at the given block coords.
+    // the cube is the smallest power of two covering the chunks and their full height.
+    // @param chunks the chunks in row-major order (z, then x), missing chunks may be null
+    void build(const std::vector<const Chunk*> &chunks, int side, glm::ivec3 corner) {
+        origin = corner;
+        depth = 0;
+        int extent = side * Chunk::SIZE > Chunk::HEIGHT ? side * Chunk::SIZE : Chunk::HEIGHT;
+        while ((1 << depth) < extent) {
+            depth++;
+        }
+        Source source = { &chunks, side };
+        nodes.clear();
+        nodes.resize(1);
+        build(source, 0, 0, 0, 0, 1 << depth);
+        nodes.shrink_to_fit();
+    }
+
+    // builds the octree on a worker thread, the chunks must stay alive until the result is taken
+    static std::future<SparseVoxelOctree> buildAsync(const std::vector<const Chunk*> &chunks, int side, glm::ivec3 corner) {
+        return std::async(std::launch::async, [&chunks, side, corner]() {
+            TraceScope scope("build octree", "x", corner.x, "z", corner.z);
+            SparseVoxelOctree octree;
+            octree.build(chunks, side, corner);
+            return octree;
+        });
+    }
+
+    // returns the side length of the cube in blocks
+    int size() const {
+        return 1 << depth;
+    }
+
+    // returns the block type at the world coords, air outside of the cube
+    BlockId get(int x, int y, int z) const {
+        x -= origin.x;
+        y -= origin.y;
+        z -= origin.z;
+        if (nodes.empty() || x < 0 || y < 0 || z < 0 || x >= size() || y >= size() || z >= size()) {
+            return block_air;
+        }
+        glm::ivec3 corner;
+        int leafSize;
+        return findLeaf(x, y, z, corner, leafSize).id;
+    }
+
+    // casts a ray through the cube, stepping from leaf to leaf so empty regions are skipped
+    // in one step no matter how large they are.
+    // @return true if a solid block was hit within maxDistance
+    bool raycast(glm::vec3 start, glm::vec3 direction, float maxDistance, RayHit &hit) const {
+        if (nodes.empty()) {
+            return false;
+        }
+        direction = glm::normalize(direction);
+        glm::vec3 local = start - glm::vec3(origin);
+        float extent = (float)size();
+
+        // clip the ray to the cube
+        float tMin = 0.0f;
+        float tMax = maxDistance;
+        for (int a = 0; a < 3; a++) {
+            if (std::abs(direction[a]) < 1e-8f) {
+                if (local[a] < 0.0f || local[a] >= extent) {
+                    return false;
+                }
+                continue;
+            }
+            float t0 = (0.0f - local[a]) / direction[a];
+            float t1 = (extent - local[a]) / direction[a];
+            if (t0 > t1) {
+                std::swap(t0, t1);
+            }
+            tMin = t0 > tMin ? t0 : tMin;
+            tMax = t1 < tMax ? t1 : tMax;
+        }
+
+        float t = tMin;
+        while (t <= tMax) {
+            glm::vec3 p = local + direction * t;
+            glm::ivec3 block = glm::ivec3(glm::floor(p));
+            block = glm::clamp(block, glm::ivec3(0), glm::ivec3(size() - 1));
+            glm::ivec3 corner;
+            int leafSize;
+            const Node &leaf = findLeaf(block.x, block.y, block.z, corner, leafSize);
+            if (leaf.id != block_air) {
+                hit.block = block + origin;
+                hit.id = leaf.id;
+                hit.distance = t;
+                return true;
+            }
+            // advance to where the ray leaves the leaf
+            float exit = tMax;
+            for (int a = 0; a < 3; a++) {
+                if (direction[a] > 0.0f) {
+                    exit = glm::min(exit, (corner[a] + leafSize - local[a]) / direction[a]);
+                } else if (direction[a] < 0.0f) {
+                    exit = glm::min(exit, (corner[a] - local[a]) / direction[a]);
+                }
+            }
+            t = glm::max(exit, t) + 1e-4f;
+        }
+        return false;
+    }
+
+    // extracts the solid cubes at a level of detail, level 0 gives single blocks and every
+    // level above doubles the size of the cubes, merged cubes take their most common type
+    void extractLod(int level, std::vector<LodCell> &cells) const {
+        cells.clear();
+        if (!nodes.empty()) {
+            extract(0, 0, 0, 0, size(), 1 << level, cells);
+        }
+    }
+
+    size_t nodeCount() const {
+        return nodes.size();
+    }
+
+    size_t memoryUsage() const {
+        return sizeof(SparseVoxelOctree) + nodes.capacity() * sizeof(Node);
+    }
+};
+
+#endif
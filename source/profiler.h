@@ -0,0 +1,201 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <glad/glad.h>
+
+#include <chrono>
+#include <iostream>
+#include <vector>
+
+// timings of a render pass, the last frame and the sum over all frames measured
+struct PassTiming {
+    const char *name;
+    double cpuMs = 0.0;
+    double gpuMs = 0.0;
+    double cpuTotalMs = 0.0;
+    double gpuTotalMs = 0.0;
+    size_t cpuFrames = 0;
+    size_t gpuFrames = 0;
+    std::chrono::steady_clock::time_point cpuStart;
+};
+
+// class to time render passes on the CPU and, with timer queries, on the GPU.
+// GPU results are read LATENCY frames late from a ring of query objects so reading them never
+// stalls the pipeline. without timer query support only the CPU times are measured
+class FrameProfiler {
+private:
+    static const int LATENCY = 4;
+    static const int MAX_PASSES = 8;
+
+    bool gpuAvailable = false;
+    // per ring slot: a GL_TIME_ELAPSED query per pass and GL_TIMESTAMP queries around the frame
+    unsigned int passQueries[LATENCY][MAX_PASSES];
+    bool passPending[LATENCY][MAX_PASSES];
+    unsigned int frameQueries[LATENCY][2];
+    bool framePending[LATENCY];
+    int slot = 0;
+    std::vector<PassTiming> passes;
+    PassTiming frameTiming;
+
+    static double toMs(GLuint64 ns) {
+        return ns / 1e6;
+    }
+
+    static void addGpu(PassTiming &timing, double ms) {
+        timing.gpuMs = ms;
+        timing.gpuTotalMs += ms;
+        ++timing.gpuFrames;
+    }
+
+    // reads the results of a ring slot, results not ready are dropped unless wait is set
+    void collect(int s, bool wait) {
+        for (size_t p = 0; p < passes.size(); p++) {
+            if (!passPending[s][p]) {
+                continue;
+            }
+            passPending[s][p] = false;
+            GLint ready = 0;
+            glGetQueryObjectiv(passQueries[s][p], GL_QUERY_RESULT_AVAILABLE, &ready);
+            if (ready || wait) {
+                GLuint64 ns = 0;
+                glGetQueryObjectui64v(passQueries[s][p], GL_QUERY_RESULT, &ns);
+                addGpu(passes[p], toMs(ns));
+            }
+        }
+        if (framePending[s]) {
+            framePending[s] = false;
+            GLint ready = 0;
+            glGetQueryObjectiv(frameQueries[s][1], GL_QUERY_RESULT_AVAILABLE, &ready);
+            if (ready || wait) {
+                GLuint64 start = 0, end = 0;
+                glGetQueryObjectui64v(frameQueries[s][0], GL_QUERY_RESULT, &start);
+                glGetQueryObjectui64v(frameQueries[s][1], GL_QUERY_RESULT, &end);
+                addGpu(frameTiming, toMs(end - start));
+            }
+        }
+    }
+
+public:
+    FrameProfiler() {
+        passes.reserve(MAX_PASSES);
+        frameTiming.name = "frame";
+    }
+
+    // creates the query objects, needs a current context.
+    // drivers report zero counter bits when they can't time, the GPU times are unavailable then
+    void init() {
+        while (glGetError() != GL_NO_ERROR) {
+        }
+        GLint elapsedBits = 0, timestampBits = 0;
+        glGetQueryiv(GL_TIME_ELAPSED, GL_QUERY_COUNTER_BITS, &elapsedBits);
+        glGetQueryiv(GL_TIMESTAMP, GL_QUERY_COUNTER_BITS, &timestampBits);
+        gpuAvailable = glGetError() == GL_NO_ERROR && elapsedBits > 0 && timestampBits > 0;
+        if (gpuAvailable) {
+            glGenQueries(LATENCY * MAX_PASSES, &passQueries[0][0]);
+            glGenQueries(LATENCY * 2, &frameQueries[0][0]);
+        }
+        for (int s = 0; s < LATENCY; s++) {
+            framePending[s] = false;
+            for (int p = 0; p < MAX_PASSES; p++) {
+                passPending[s][p] = false;
+            }
+        }
+    }
+
+    // deletes the query objects while the context is still current
+    void destroy() {
+        if (gpuAvailable) {
+            glDeleteQueries(LATENCY * MAX_PASSES, &passQueries[0][0]);
+            glDeleteQueries(LATENCY * 2, &frameQueries[0][0]);
+            gpuAvailable = false;
+        }
+    }
+
+    // registers a pass, passes can't nest since only one elapsed time query can be active
+    // @return the id to time the pass with
+    int addPass(const char *name) {
+        PassTiming timing;
+        timing.name = name;
+        passes.push_back(timing);
+        return passes.size() - 1;
+    }
+
+    void beginFrame() {
+        if (gpuAvailable) {
+            glQueryCounter(frameQueries[slot][0], GL_TIMESTAMP);
+        }
+    }
+
+    void begin(int pass) {
+        passes[pass].cpuStart = std::chrono::steady_clock::now();
+        if (gpuAvailable) {
+            glBeginQuery(GL_TIME_ELAPSED, passQueries[slot][pass]);
+        }
+    }
+
+    void end(int pass) {
+        if (gpuAvailable) {
+            glEndQuery(GL_TIME_ELAPSED);
+            passPending[slot][pass] = true;
+        }
+        PassTiming &timing = passes[pass];
+        timing.cpuMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - timing.cpuStart).count();
+        timing.cpuTotalMs += timing.cpuMs;
+        ++timing.cpuFrames;
+    }
+
+    // moves on to the next slot of the ring, reading the results it holds from LATENCY frames ago
+    void endFrame() {
+        if (!gpuAvailable) {
+            return;
+        }
+        glQueryCounter(frameQueries[slot][1], GL_TIMESTAMP);
+        framePending[slot] = true;
+        slot = (slot + 1) % LATENCY;
+        collect(slot, false);
+    }
+
+    // waits for the results of the frames still in flight, e.g. before reporting
+    void finish() {
+        if (!gpuAvailable) {
+            return;
+        }
+        for (int i = 1; i <= LATENCY; i++) {
+            collect((slot + i) % LATENCY, true);
+        }
+    }
+
+    bool isGpuAvailable() {
+        return gpuAvailable;
+    }
+
+    const std::vector<PassTiming> &getPasses() {
+        return passes;
+    }
+
+    // returns the GPU time from the start to the end of the last frame read back
+    const PassTiming &getFrame() {
+        return frameTiming;
+    }
+
+    // prints the average CPU and GPU time of every pass that ran
+    void report(std::ostream &out) {
+        for (size_t p = 0; p < passes.size(); p++) {
+            const PassTiming &timing = passes[p];
+            if (timing.cpuFrames == 0) {
+                continue;
+            }
+            out << "pass " << timing.name << ": cpu " << timing.cpuTotalMs / timing.cpuFrames << " ms, gpu ";
+            if (gpuAvailable && timing.gpuFrames) {
+                out << timing.gpuTotalMs / timing.gpuFrames << " ms" << std::endl;
+            } else {
+                out << "unavailable" << std::endl;
+            }
+        }
+        if (gpuAvailable && frameTiming.gpuFrames) {
+            out << "gpu frame: " << frameTiming.gpuTotalMs / frameTiming.gpuFrames << " ms" << std::endl;
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,341 @@
+#include <region.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <sstream>
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// file layout: magic, version, seed and width of the terrain, then one 16 byte entry per chunk
+// (payload offset, payload size, uncompressed size, codec), then the payloads
+static const char MAGIC[4] = { 'T', 'R', 'G', 'N' };
+static const std::uint32_t VERSION = 2;
+static const size_t ENTRY_SIZE = 16;
+static const size_t TABLE_OFFSET = 16;
+static const size_t HEADER_SIZE = TABLE_OFFSET + RegionFile::CHUNKS * ENTRY_SIZE;
+// replaced payloads are left in place until they are at least this many bytes and more than the
+// live ones, so a file is compacted after about as many rewrites as it has chunks
+static const size_t COMPACT_MIN_BYTES = 1 << 16;
+
+static std::uint32_t readU32(const unsigned char *in) {
+    return in[0] | (in[1] << 8) | (in[2] << 16) | ((std::uint32_t)in[3] << 24);
+}
+
+static void writeU32(unsigned char *out, std::uint32_t value) {
+    out[0] = value;
+    out[1] = value >> 8;
+    out[2] = value >> 16;
+    out[3] = value >> 24;
+}
+
+static int floorDiv(int a, int b) {
+    return a >= 0 ? a / b : -((-a + b - 1) / b);
+}
+
+// returns true if the payloads no table entry points at take up more than the live ones
+static bool needsCompaction(const unsigned char *header, size_t fileSize) {
+    size_t live = 0;
+    for (int c = 0; c < RegionFile::CHUNKS; c++) {
+        const unsigned char *entry = header + TABLE_OFFSET + c * ENTRY_SIZE;
+        if (readU32(entry) != 0) {
+            live += readU32(entry + 4);
+        }
+    }
+    size_t dead = fileSize - HEADER_SIZE - std::min(live, fileSize - HEADER_SIZE);
+    return dead >= COMPACT_MIN_BYTES && dead > live;
+}
+
+void RegionFile::writeHeader(unsigned char *header) {
+    memcpy(header, MAGIC, 4);
+    writeU32(header + 4, VERSION);
+    writeU32(header + 8, seed);
+    writeU32(header + 12, width);
+}
+
+bool RegionFile::checkHeader(const unsigned char *header) {
+    int fileSeed = (int)readU32(header + 8);
+    int fileWidth = (int)readU32(header + 12);
+    if (memcmp(header, MAGIC, 4) != 0 || readU32(header + 4) != VERSION) {
+        std::cout << "Failed to read region file " << path << std::endl;
+    } else if (fileSeed != seed || fileWidth != width) {
+        std::cout << "Region file " << path << " holds terrain of seed " << fileSeed << " and width " << fileWidth
+                  << ", not " << seed << " and " << width << std::endl;
+    } else {
+        return true;
+    }
+    rejected = true;
+    return false;
+}
+
+bool RegionFile::compact() {
+    std::vector<unsigned char> contents;
+    {
+        std::ifstream file(path.c_str(), std::ios::binary);
+        contents.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    }
+    if (contents.size() < HEADER_SIZE) {
+        return false;
+    }
+    std::vector<unsigned char> compacted(contents.begin(), contents.begin() + HEADER_SIZE);
+    for (int c = 0; c < CHUNKS; c++) {
+        unsigned char *entry = compacted.data() + TABLE_OFFSET + c * ENTRY_SIZE;
+        size_t offset = readU32(entry);
+        size_t size = readU32(entry + 4);
+        if (offset == 0) {
+            continue;
+        }
+        if (offset + size > contents.size()) {
+            memset(entry, 0, ENTRY_SIZE);
+            continue;
+        }
+        writeU32(entry, compacted.size());
+        compacted.insert(compacted.end(), contents.begin() + offset, contents.begin() + offset + size);
+    }
+    // written next to the file and renamed over it, so a crash leaves either version whole
+    std::string temp = path + ".tmp";
+    std::ofstream file(temp.c_str(), std::ios::binary | std::ios::trunc);
+    file.write((const char*)compacted.data(), compacted.size());
+    file.close();
+    if (!file) {
+        std::remove(temp.c_str());
+        return false;
+    }
+    unmap();
+#ifdef _WIN32
+    // rename doesn't replace an existing file here
+    std::remove(path.c_str());
+#endif
+    return std::rename(temp.c_str(), path.c_str()) == 0;
+}
+
+bool RegionFile::map() {
+    unmap();
+    if (rejected) {
+        return false;
+    }
+#ifdef _WIN32
+    std::ifstream file(path.c_str(), std::ios::binary);
+    if (!file) {
+        return false;
+    }
+    contents.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    mapped = contents.data();
+    mappedSize = contents.size();
+#else
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < HEADER_SIZE) {
+        close(fd);
+        return false;
+    }
+    void *data = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        return false;
+    }
+    mapped = (const unsigned char*)data;
+    mappedSize = st.st_size;
+#endif
+    if (mappedSize < HEADER_SIZE || !checkHeader(mapped)) {
+        unmap();
+        return false;
+    }
+    return true;
+}
+
+void RegionFile::unmap() {
+#ifdef _WIN32
+    contents.clear();
+#else
+    if (mapped != nullptr) {
+        munmap((void*)mapped, mappedSize);
+    }
+#endif
+    mapped = nullptr;
+    mappedSize = 0;
+}
+
+bool RegionFile::find(int x, int z, const unsigned char *&payload, size_t &size, unsigned int &codec, size_t &rawSize) {
+    if (mapped == nullptr && !map()) {
+        return false;
+    }
+    const unsigned char *entry = mapped + TABLE_OFFSET + (z * SIZE + x) * ENTRY_SIZE;
+    size_t offset = readU32(entry);
+    size = readU32(entry + 4);
+    rawSize = readU32(entry + 8);
+    codec = entry[12];
+    if (offset == 0) {
+        return false;
+    }
+    // the payload was appended after the file was mapped
+    if (offset + size > mappedSize && (!map() || offset + size > mappedSize)) {
+        return false;
+    }
+    payload = mapped + offset;
+    return true;
+}
+
+bool RegionFile::write(int x, int z, const unsigned char *payload, size_t size, unsigned int codec, size_t rawSize) {
+    unsigned char entry[ENTRY_SIZE] = { 0 };
+    std::vector<unsigned char> header(HEADER_SIZE, 0);
+    if (rejected) {
+        return false;
+    }
+#ifdef _WIN32
+    std::fstream file(path.c_str(), std::ios::in | std::ios::out | std::ios::binary);
+    if (!file) {
+        writeHeader(header.data());
+        std::ofstream create(path.c_str(), std::ios::binary);
+        create.write((const char*)header.data(), header.size());
+        create.close();
+        file.open(path.c_str(), std::ios::in | std::ios::out | std::ios::binary);
+    } else {
+        file.seekg(0, std::ios::end);
+        size_t end = file.tellg();
+        file.seekg(0);
+        file.read((char*)header.data(), header.size());
+        if (!file || !checkHeader(header.data())) {
+            return false;
+        }
+        if (needsCompaction(header.data(), end)) {
+            file.close();
+            return compact() && write(x, z, payload, size, codec, rawSize);
+        }
+    }
+    file.seekp(0, std::ios::end);
+    size_t offset = file.tellp();
+    file.write((const char*)payload, size);
+    writeU32(entry, offset);
+    writeU32(entry + 4, size);
+    writeU32(entry + 8, rawSize);
+    entry[12] = codec;
+    file.seekp(TABLE_OFFSET + (z * SIZE + x) * ENTRY_SIZE);
+    file.write((const char*)entry, ENTRY_SIZE);
+    bool ok = (bool)file;
+    file.close();
+    // the in-memory copy is stale now
+    unmap();
+    return ok;
+#else
+    int fd = open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        return false;
+    }
+    off_t end = lseek(fd, 0, SEEK_END);
+    if (end < (off_t)HEADER_SIZE) {
+        writeHeader(header.data());
+        if (pwrite(fd, header.data(), header.size(), 0) != (ssize_t)header.size()) {
+            close(fd);
+            return false;
+        }
+        end = HEADER_SIZE;
+    } else {
+        if (pread(fd, header.data(), header.size(), 0) != (ssize_t)header.size() || !checkHeader(header.data())) {
+            close(fd);
+            return false;
+        }
+        if (needsCompaction(header.data(), end)) {
+            close(fd);
+            return compact() && write(x, z, payload, size, codec, rawSize);
+        }
+    }
+    writeU32(entry, end);
+    writeU32(entry + 4, size);
+    writeU32(entry + 8, rawSize);
+    entry[12] = codec;
+    // payload first so a crash never leaves an entry pointing past the end of the file
+    bool ok = pwrite(fd, payload, size, end) == (ssize_t)size
+        && pwrite(fd, entry, ENTRY_SIZE, TABLE_OFFSET + (z * SIZE + x) * ENTRY_SIZE) == (ssize_t)ENTRY_SIZE;
+    close(fd);
+    // the shared mapping sees the new table entry, the payload is mapped on the next find
+    return ok;
+#endif
+}
+
+RegionStore::RegionStore(const std::string &directory, int seed, int width, const Codec *codec)
+    :directory(directory), seed(seed), width(width), codec(codec) {
+#ifdef _WIN32
+    _mkdir(directory.c_str());
+#else
+    mkdir(directory.c_str(), 0755);
+#endif
+}
+
+RegionFile &RegionStore::region(int rx, int rz) {
+    std::unique_ptr<RegionFile> &file = regions[std::make_pair(rx, rz)];
+    if (!file) {
+        std::stringstream name;
+        name << directory << "/r." << rx << "." << rz << ".trg";
+        file.reset(new RegionFile(name.str(), seed, width));
+    }
+    return *file;
+}
+
+bool RegionStore::load(int cx, int cz, Chunk &chunk) {
+    int rx = floorDiv(cx, RegionFile::SIZE);
+    int rz = floorDiv(cz, RegionFile::SIZE);
+    const unsigned char *payload;
+    size_t size, rawSize;
+    unsigned int payloadCodec;
+    if (!region(rx, rz).find(cx - rx * RegionFile::SIZE, cz - rz * RegionFile::SIZE, payload, size, payloadCodec, rawSize)) {
+        return false;
+    }
+    if (payloadCodec == codec_stored) {
+        return chunk.deserialize(payload, size);
+    }
+    const Codec *payloadDecoder = findCodec(payloadCodec);
+    if (payloadDecoder == nullptr) {
+        std::cout << "Chunk " << cx << ", " << cz << " uses a codec missing in this build" << std::endl;
+        return false;
+    }
+    return payloadDecoder->decompress(payload, size, raw, rawSize) && chunk.deserialize(raw.data(), raw.size());
+}
+
+bool RegionStore::save(int cx, int cz, const Chunk &chunk) {
+    int rx = floorDiv(cx, RegionFile::SIZE);
+    int rz = floorDiv(cz, RegionFile::SIZE);
+    raw.clear();
+    chunk.serialize(raw);
+    // stored payloads are written straight from the serialized chunk
+    const std::vector<unsigned char> *payload = &raw;
+    if (codec->id() != codec_stored) {
+        if (!codec->compress(raw.data(), raw.size(), packed)) {
+            std::cout << "Failed to compress chunk " << cx << ", " << cz << " with " << codec->name() << std::endl;
+            return false;
+        }
+        payload = &packed;
+    }
+    return region(rx, rz).write(cx - rx * RegionFile::SIZE, cz - rz * RegionFile::SIZE,
+        payload->data(), payload->size(), codec->id(), raw.size());
+}
+
+bool RegionStore::savePayload(int cx, int cz, const unsigned char *payload, size_t size, unsigned int codec, size_t rawSize) {
+    int rx = floorDiv(cx, RegionFile::SIZE);
+    int rz = floorDiv(cz, RegionFile::SIZE);
+    return region(rx, rz).write(cx - rx * RegionFile::SIZE, cz - rz * RegionFile::SIZE, payload, size, codec, rawSize);
+}
+
+bool RegionStore::loadOrGenerate(int cx, int cz, Terrain &terrain, Arena &scratch, Chunk &chunk) {
+    if (load(cx, cz, chunk)) {
+        return false;
+    }
+    terrain.genChunk(cx, cz, scratch, chunk);
+    if (!save(cx, cz, chunk)) {
+        std::cout << "Failed to write chunk " << cx << ", " << cz << " to " << directory << std::endl;
+    }
+    return true;
+}
@@ -0,0 +1,117 @@
+#ifndef REGION_H
+#define REGION_H
+
+#include <chunk.h>
+#include <codec.h>
+#include <terraingen.h>
+#include <arena.h>
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+// class to access a region file holding a 32x32 square of chunks. the file starts with a
+// header recording the seed and width of the terrain and an offset table with an entry per chunk,
+// followed by the compressed payloads. reads go through a read-only memory mapping so looking up
+// a chunk copies nothing, writes append the new payload and point the table entry at it.
+// the payloads a rewrite replaces stay in the file until they outgrow the live ones, then the
+// file is compacted, so a file stays under about twice the size of its chunks
+class RegionFile {
+private:
+    std::string path;
+    int seed;
+    int width;
+    // set once the file turned out to belong to other terrain, it is neither read nor written then
+    bool rejected = false;
+    const unsigned char *mapped = nullptr;
+    size_t mappedSize = 0;
+#ifdef _WIN32
+    // no mmap, the file is read into memory instead
+    std::vector<unsigned char> contents;
+#endif
+
+    // maps the current contents of the file, false if it doesn't exist, is no region file or
+    // was written for other terrain
+    bool map();
+    void unmap();
+
+    // fills the magic, version, seed and width of a new file
+    void writeHeader(unsigned char *header);
+
+    // returns true if the header was written for the terrain of this file, reporting it if not
+    bool checkHeader(const unsigned char *header);
+
+    // rewrites the file with only the payloads the table points at, if the ones rewrites replaced
+    // take up more than those. the file must be mapped
+    bool compact();
+
+public:
+    static const int SIZE = 32;
+    static const int CHUNKS = SIZE * SIZE;
+
+    // @param seed, width of the terrain the chunks of the file are generated from
+    RegionFile(const std::string &path, int seed, int width):path(path), seed(seed), width(width) {}
+
+    ~RegionFile() {
+        unmap();
+    }
+
+    RegionFile(const RegionFile&) = delete;
+    RegionFile &operator=(const RegionFile&) = delete;
+
+    // looks up the payload of the chunk at the local coords, pointing into the mapping
+    // @return false if the chunk isn't stored
+    bool find(int x, int z, const unsigned char *&payload, size_t &size, unsigned int &codec, size_t &rawSize);
+
+    // appends a payload for the chunk at the local coords, creating the file if needed
+    // @return false if the file couldn't be written
+    bool write(int x, int z, const unsigned char *payload, size_t size, unsigned int codec, size_t rawSize);
+};
+
+// class to persist chunks in a directory of region files, chunks missing on disk are
+// generated and written back so the next run loads them instead.
+// every payload records its codec, so regions written with different codecs can be mixed.
+// region files of terrain with another seed or width are rejected instead of mixed in
+class RegionStore {
+private:
+    std::string directory;
+    int seed;
+    int width;
+    const Codec *codec;
+    std::map<std::pair<int, int>, std::unique_ptr<RegionFile>> regions;
+    // serialized and compressed chunks, reused between chunks
+    std::vector<unsigned char> raw;
+    std::vector<unsigned char> packed;
+
+    RegionFile &region(int rx, int rz);
+
+public:
+    // @param directory where the region files live, created if missing
+    // @param seed, width of the terrain the chunks are generated from
+    // @param codec the codec new payloads are written with
+    RegionStore(const std::string &directory, int seed, int width, const Codec *codec = findCodec(codec_rle));
+
+    // returns the codec new payloads are written with
+    const Codec *getCodec() {
+        return codec;
+    }
+
+    // reads the chunk at cx, cz
+    // @return false if it isn't on disk
+    bool load(int cx, int cz, Chunk &chunk);
+
+    // writes the chunk at cx, cz
+    bool save(int cx, int cz, const Chunk &chunk);
+
+    // writes a payload already compressed with the given codec for the chunk at cx, cz
+    bool savePayload(int cx, int cz, const unsigned char *payload, size_t size, unsigned int codec, size_t rawSize);
+
+    // reads the chunk at cx, cz, generating and saving it if it isn't on disk
+    // @return true if the chunk was generated
+    bool loadOrGenerate(int cx, int cz, Terrain &terrain, Arena &scratch, Chunk &chunk);
+};
+
+#endif
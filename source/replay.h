@@ -0,0 +1,159 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <camera.h>
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// a frame without movement
+const int key_none = -1;
+
+// class to hold the key pressed in every frame of a camera path, for replaying the same
+// movement at a fixed timestep. the file format has a line per run of frames,
+// "<frames> <key>" where key is w, a, s, d or - for none, # starts a comment
+class CameraPath {
+private:
+    std::vector<int> keys;
+
+    static char toChar(int key) {
+        switch (key) {
+        case key_w: return 'w';
+        case key_a: return 'a';
+        case key_s: return 's';
+        case key_d: return 'd';
+        default: return '-';
+        }
+    }
+
+    static bool fromChar(char c, int &key) {
+        switch (c) {
+        case 'w': key = key_w; return true;
+        case 'a': key = key_a; return true;
+        case 's': key = key_s; return true;
+        case 'd': key = key_d; return true;
+        case '-': key = key_none; return true;
+        default: return false;
+        }
+    }
+
+public:
+    // reads a path file
+    // @return false if it can't be read or has a malformed line
+    bool load(const std::string &path) {
+        std::ifstream file(path.c_str());
+        if (!file) {
+            std::cout << "Failed to read camera path " << path << std::endl;
+            return false;
+        }
+        keys.clear();
+        std::string line;
+        int lineNumber = 0;
+        while (std::getline(file, line)) {
+            ++lineNumber;
+            line = line.substr(0, line.find('#'));
+            std::istringstream in(line);
+            int frames;
+            std::string key;
+            if (!(in >> frames)) {
+                continue;
+            }
+            int value;
+            if (!(in >> key) || key.size() != 1 || !fromChar(key[0], value) || frames < 0) {
+                std::cout << "Failed to parse line " << lineNumber << " of camera path " << path << std::endl;
+                return false;
+            }
+            keys.insert(keys.end(), frames, value);
+        }
+        return true;
+    }
+
+    // writes the path, merging frames with the same key into one line
+    bool save(const std::string &path) {
+        std::ofstream file(path.c_str());
+        for (size_t i = 0; i < keys.size();) {
+            size_t run = 1;
+            while (i + run < keys.size() && keys[i + run] == keys[i]) {
+                run++;
+            }
+            file << run << " " << toChar(keys[i]) << "\n";
+            i += run;
+        }
+        return (bool)file;
+    }
+
+    // appends a frame
+    void record(int key) {
+        keys.push_back(key);
+    }
+
+    size_t size() {
+        return keys.size();
+    }
+
+    // returns the key of the frame, the path repeats if it is shorter than the replay
+    int keyAt(size_t frame) {
+        return keys.empty() ? key_none : keys[frame % keys.size()];
+    }
+};
+
+// class to collect per-frame timings and work of a replay and summarize them
+class FrameStats {
+private:
+    std::vector<double> frameMs;
+    size_t triangles = 0;
+    size_t drawCalls = 0;
+    size_t stateChanges = 0;
+
+    // returns the value below which the given fraction of the sorted values lies
+    static double percentile(const std::vector<double> &sorted, double fraction) {
+        size_t index = (size_t)(fraction * (sorted.size() - 1) + 0.5);
+        return sorted[index];
+    }
+
+public:
+    void reserve(size_t frames) {
+        frameMs.reserve(frames);
+    }
+
+    // @param frameStateChanges the program, VAO and texture binds issued
+    void addFrame(double ms, size_t frameTriangles, size_t frameDrawCalls, size_t frameStateChanges = 0) {
+        frameMs.push_back(ms);
+        triangles += frameTriangles;
+        drawCalls += frameDrawCalls;
+        stateChanges += frameStateChanges;
+    }
+
+    size_t frames() {
+        return frameMs.size();
+    }
+
+    // prints the frame time distribution and the average work per frame
+    void report(std::ostream &out) {
+        if (frameMs.empty()) {
+            out << "no frames" << std::endl;
+            return;
+        }
+        std::vector<double> sorted(frameMs);
+        std::sort(sorted.begin(), sorted.end());
+        double total = 0.0;
+        for (size_t i = 0; i < sorted.size(); i++) {
+            total += sorted[i];
+        }
+        out << "frame ms: min " << sorted.front()
+            << " avg " << total / sorted.size()
+            << " p50 " << percentile(sorted, 0.5)
+            << " p90 " << percentile(sorted, 0.9)
+            << " p99 " << percentile(sorted, 0.99)
+            << " max " << sorted.back() << std::endl;
+        out << "per frame: " << triangles / sorted.size() << " triangles, "
+            << drawCalls / sorted.size() << " draw calls, "
+            << stateChanges / sorted.size() << " state changes" << std::endl;
+    }
+};
+
+#endif
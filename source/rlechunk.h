@@ -0,0 +1,293 @@
+#ifndef RLECHUNK_H
+#define RLECHUNK_H
+
+#include <chunk.h>
+
+#include <cassert>
+#include <cstdint>
+#include <vector>
+
+// a run of equal blocks in a column, packed into 16 bits: block types below block_type_limit and
+// runs up to the whole height of a chunk
+struct BlockRun {
+    std::uint16_t id : 7;
+    std::uint16_t length : 9;
+};
+static_assert(sizeof(BlockRun) == 2, "a run should pack into 16 bits");
+static_assert(block_type_limit == 1 << 7, "block types should fit the id of a run");
+
+// iterates the runs of a column bottom to top, tracking the height each run starts at
+class RunIterator {
+private:
+    const BlockRun *run;
+    int y;
+
+public:
+    RunIterator(const BlockRun *run, int y):run(run), y(y) {}
+
+    const BlockRun &operator*() const {
+        return *run;
+    }
+
+    const BlockRun *operator->() const {
+        return run;
+    }
+
+    RunIterator &operator++() {
+        y += run->length;
+        ++run;
+        return *this;
+    }
+
+    bool operator!=(const RunIterator &other) const {
+        return run != other.run;
+    }
+
+    // returns the height of the lowest block of the run
+    int bottom() const {
+        return y;
+    }
+
+    // returns the height just above the highest block of the run
+    int top() const {
+        return y + run->length;
+    }
+};
+
+// the runs of one column, usable in range-based for loops
+class ColumnRuns {
+private:
+    const BlockRun *first;
+    const BlockRun *last;
+
+public:
+    ColumnRuns(const BlockRun *first, const BlockRun *last):first(first), last(last) {}
+
+    RunIterator begin() const {
+        return RunIterator(first, 0);
+    }
+
+    RunIterator end() const {
+        return RunIterator(last, 0);
+    }
+
+    bool empty() const {
+        return first == last;
+    }
+};
+
+// class to store a chunk as run-length encoded columns. air above the last run is implicit,
+// so a heightfield column is a dirt run and a grass run no matter how tall it is and the
+// memory of a chunk follows the complexity of its surface instead of its volume
+class RleChunk {
+public:
+    static const int SIZE = Chunk::SIZE;
+    static const int HEIGHT = Chunk::HEIGHT;
+    static const int COLUMNS = SIZE * SIZE;
+
+private:
+    // runs of all columns back to back, column c owns runs [offset(c), offset(c + 1))
+    std::vector<BlockRun> runs;
+    // where the runs of every column start and the last one ends, as narrow as the number of runs
+    // allows: no table while every column is empty, 16 bit offsets up to 65535 runs, 32 bit past it
+    std::vector<std::uint16_t> narrowOffsets;
+    std::vector<std::uint32_t> wideOffsets;
+
+    static int columnOf(int x, int z) {
+        return z * SIZE + x;
+    }
+
+    size_t offset(int c) const {
+        if (!wideOffsets.empty()) {
+            return wideOffsets[c];
+        }
+        return narrowOffsets.empty() ? 0 : narrowOffsets[c];
+    }
+
+    // adds delta to the offsets from column c on, after runs changed size by delta
+    void shiftOffsets(int c, int delta) {
+        if (wideOffsets.empty() && runs.size() > 0xffff) {
+            wideOffsets.assign(COLUMNS + 1, 0);
+            for (size_t i = 0; i < narrowOffsets.size(); i++) {
+                wideOffsets[i] = narrowOffsets[i];
+            }
+            narrowOffsets.clear();
+            narrowOffsets.shrink_to_fit();
+        } else if (wideOffsets.empty() && narrowOffsets.empty()) {
+            narrowOffsets.assign(COLUMNS + 1, 0);
+        }
+        for (int i = c; i <= COLUMNS; i++) {
+            if (!wideOffsets.empty()) {
+                wideOffsets[i] += delta;
+            } else {
+                narrowOffsets[i] += delta;
+            }
+        }
+    }
+
+public:
+    RleChunk() {
+        clear();
+    }
+
+    // makes every column empty (all air), runs and offsets keep their storage
+    void clear() {
+        runs.clear();
+        narrowOffsets.clear();
+        wideOffsets.clear();
+    }
+
+    // returns the runs of the column at the local coords
+    ColumnRuns column(int x, int z) const {
+        const BlockRun *base = runs.data();
+        int c = columnOf(x, z);
+        return ColumnRuns(base + offset(c), base + offset(c + 1));
+    }
+
+    // replaces the runs of a column. columns filled in order (z, then x) only append,
+    // otherwise the runs of the following columns are moved
+    void setColumn(int x, int z, const BlockRun *columnRuns, int count) {
+        int c = columnOf(x, z);
+        // drop trailing air, it is implicit
+        while (count > 0 && columnRuns[count - 1].id == block_air) {
+            count--;
+        }
+        size_t first = offset(c);
+        size_t last = offset(c + 1);
+        int delta = count - (int)(last - first);
+        if (delta > 0) {
+            runs.insert(runs.begin() + last, delta, BlockRun());
+        } else if (delta < 0) {
+            runs.erase(runs.begin() + last + delta, runs.begin() + last);
+        }
+        for (int i = 0; i < count; i++) {
+            runs[first + i] = columnRuns[i];
+        }
+        if (delta != 0) {
+            shiftOffsets(c + 1, delta);
+        }
+    }
+
+    // returns the block type at the local coords
+    BlockId get(int x, int y, int z) const {
+        ColumnRuns col = column(x, z);
+        for (RunIterator it = col.begin(); it != col.end(); ++it) {
+            if (y < it.top()) {
+                return y >= it.bottom() ? it->id : (BlockId)block_air;
+            }
+        }
+        return block_air;
+    }
+
+    // sets the block type at the local coords by splitting or merging the runs of its column
+    void set(int x, int y, int z, BlockId id) {
+        BlockRun edited[HEIGHT + 2];
+        int count = 0;
+        int height = 0;
+        ColumnRuns col = column(x, z);
+        for (RunIterator it = col.begin(); it != col.end(); ++it) {
+            height = it.top();
+            append(edited, count, it->id, it->length);
+        }
+        if (height <= y) {
+            append(edited, count, block_air, y - height + 1);
+        }
+        // rebuild the column around the edited block
+        BlockRun result[HEIGHT + 2];
+        int resultCount = 0;
+        int bottom = 0;
+        for (int i = 0; i < count; i++) {
+            int top = bottom + edited[i].length;
+            if (y >= bottom && y < top) {
+                append(result, resultCount, edited[i].id, y - bottom);
+                append(result, resultCount, id, 1);
+                append(result, resultCount, edited[i].id, top - y - 1);
+            } else {
+                append(result, resultCount, edited[i].id, edited[i].length);
+            }
+            bottom = top;
+        }
+        setColumn(x, z, result, resultCount);
+    }
+
+    // appends a run to a column being built, merging it with the previous run if possible.
+    // every run goes through here, so this is where ids past block_type_limit would be truncated
+    static void append(BlockRun *column, int &count, BlockId id, int length) {
+        assert(id < block_type_limit);
+        if (length <= 0) {
+            return;
+        }
+        if (count > 0 && column[count - 1].id == id) {
+            column[count - 1].length += length;
+            return;
+        }
+        column[count].id = id;
+        column[count].length = length;
+        count++;
+    }
+
+    // returns the height just above the highest solid block of the column, 0 if it is empty
+    int topHeight(int x, int z) const {
+        int top = 0;
+        ColumnRuns col = column(x, z);
+        for (RunIterator it = col.begin(); it != col.end(); ++it) {
+            if (it->id != block_air) {
+                top = it.top();
+            }
+        }
+        return top;
+    }
+
+    // calls fn(x, y, z, id) for every block that isn't air, in the same way as Chunk
+    template <typename Fn>
+    void forEachSolid(Fn fn) const {
+        for (int z = 0; z < SIZE; z++) {
+            for (int x = 0; x < SIZE; x++) {
+                ColumnRuns col = column(x, z);
+                for (RunIterator it = col.begin(); it != col.end(); ++it) {
+                    if (it->id == block_air) {
+                        continue;
+                    }
+                    for (int y = it.bottom(); y < it.top(); y++) {
+                        fn(x, y, z, it->id);
+                    }
+                }
+            }
+        }
+    }
+
+    // encodes the columns of a chunk
+    void fromChunk(const Chunk &chunk) {
+        clear();
+        BlockRun column[HEIGHT];
+        for (int z = 0; z < SIZE; z++) {
+            for (int x = 0; x < SIZE; x++) {
+                int count = 0;
+                for (int y = 0; y < HEIGHT; y++) {
+                    append(column, count, chunk.get(x, y, z), 1);
+                }
+                setColumn(x, z, column, count);
+            }
+        }
+    }
+
+    // decodes the columns into a chunk
+    void toChunk(Chunk &chunk) const {
+        chunk.clear();
+        forEachSolid([&](int x, int y, int z, BlockId id) {
+            chunk.set(x, y, z, id);
+        });
+    }
+
+    // returns the number of runs of all columns
+    size_t runCount() const {
+        return runs.size();
+    }
+
+    size_t memoryUsage() const {
+        return sizeof(RleChunk) + runs.capacity() * sizeof(BlockRun)
+            + narrowOffsets.capacity() * sizeof(std::uint16_t) + wideOffsets.capacity() * sizeof(std::uint32_t);
+    }
+};
+
+#endif
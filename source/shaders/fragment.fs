@@ -2,6 +2,7 @@
 out vec4 FragColor;
 
 in vec2 TexCoord;
+in float Light;
 
 // texture samplers
 uniform sampler2D texture1;
@@ -9,4 +10,5 @@ uniform sampler2D texture1;
 void main()
 {
 	FragColor = texture(texture1, TexCoord);
+	FragColor.rgb *= Light;
 }
\ No newline at end of file
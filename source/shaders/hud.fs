@@ -0,0 +1,13 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec2 TexCoord;
+in vec4 Color;
+
+// coverage of the glyphs in the red channel
+uniform sampler2D font;
+
+void main()
+{
+	FragColor = vec4(Color.rgb, Color.a * texture(font, TexCoord).r);
+}
\ No newline at end of file
@@ -0,0 +1,17 @@
+#version 330 core
+layout (location = 0) in vec2 aPos;
+layout (location = 1) in vec2 aTexCoord;
+layout (location = 2) in vec4 aColor;
+
+out vec2 TexCoord;
+out vec4 Color;
+
+// size of the framebuffer in pixels, positions are in pixels from the top left
+uniform vec2 screen;
+
+void main()
+{
+	gl_Position = vec4(aPos.x / screen.x * 2.0 - 1.0, 1.0 - aPos.y / screen.y * 2.0, 0.0, 1.0);
+	TexCoord = aTexCoord;
+	Color = aColor;
+}
\ No newline at end of file
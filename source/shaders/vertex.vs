@@ -1,8 +1,14 @@
 #version 330 core
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec2 aTexCoord;
+// ambient occlusion baked by the mesher
+layout (location = 2) in float aLight;
 
 out vec2 TexCoord;
+out float Light;
+
+// the depth pre-pass of depth.vs has to produce the same depths
+invariant gl_Position;
 
 uniform mat4 model;
 uniform mat4 view;
@@ -12,4 +18,5 @@ void main()
 {
 	gl_Position = projection * view * model * vec4(aPos, 1.0);
 	TexCoord = vec2(aTexCoord.x, aTexCoord.y);
+	Light = aLight;
 }
\ No newline at end of file
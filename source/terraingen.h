@@ -5,53 +5,175 @@
 #include <includes/glm/gtc/matrix_transform.hpp>
 #include <includes/glm/gtc/type_ptr.hpp>
 #include <includes/PerlinNoise.hpp>
+#include <arena.h>
+#include <chunk.h>
+#include <rlechunk.h>
 
 #include <vector>
 
 // class to generate coordinates
 class Terrain {
 private:
-    std::vector<glm::vec4> coords;
     int width;
     int seed;
-public:
-    Terrain(int width = 100, int seed = 0):width(width), seed(seed) {}
+    siv::PerlinNoise perlin;
+    // bounds of the last generated square and a counter bumped on every regeneration
+    int lastXStart = 0;
+    int lastXEnd = 0;
+    int lastZStart = 0;
+    int lastZEnd = 0;
+    unsigned int version = 0;
 
-    // generate vectors of world space coords.
-    // @param width the width of the square of coords to generate
-    // @param seed the random seed
-    std::vector<glm::vec4> genCoords(glm::vec3 worldPos) {
-        coords.clear();
+    // the generated square only depends on where its bounds fall
+    int squareStart(float pos) {
+        return (-1) * (width / 2) + pos;
+    }
+
+    int squareEnd(float pos) {
+        return width / 2 + pos;
+    }
 
-        int xStart = (-1) * (width / 2) + worldPos.x;
-        int xEnd = width / 2 + worldPos.x;
-        int zStart = (-1) * (width / 2) + worldPos.z;
-        int zEnd = width / 2 + worldPos.z;
+    // writes the blocks of a column, dirt up to the top which is grass
+    // @return the number of coords written, height + 1
+    static size_t emitColumn(int x, int z, int height, glm::vec4 *out) {
+        out[0] = glm::vec4(x, 0.0f, z, 0);
+        for (int h = 1; h <= height; ++h) {
+            if (h == height) {
+                out[h] = glm::vec4(x, h, z, 1);
+            } else {
+                out[h] = glm::vec4(x, h, z, 0);
+            }
+        }
+        return height + 1;
+    }
+public:
+    // highest block a column can reach
+    static const int MAX_HEIGHT = 5;
+    // side length of a chunk in blocks
+    static const int CHUNK_SIZE = 16;
 
-		siv::PerlinNoise perlin;
+    Terrain(int width = 100, int seed = 0):width(width), seed(seed) {
         if (seed != 0) {
             perlin.reseed(seed);
         }
+    }
+
+    // returns an upper bound on the number of coords genCoords can produce,
+    // the square spans at most width + 1 blocks per side depending on the position
+    size_t maxCoords() {
+        return (size_t)(width + 1) * (width + 1) * (MAX_HEIGHT + 1);
+    }
+
+    // returns the number of coords a chunk can hold at most
+    static size_t chunkCapacity() {
+        return CHUNK_SIZE * CHUNK_SIZE * (MAX_HEIGHT + 1);
+    }
+
+    // returns the width of the square of coords to generate
+    int getWidth() {
+        return width;
+    }
 
-		const double fx = width / 4;
-		const double fz = width / 4;
+    int getSeed() {
+        return seed;
+    }
+
+    // returns the height of the top block of the column at x, z
+    int columnHeight(int x, int z) {
+        const double fx = width / 4;
+        const double fz = width / 4;
+        float f = perlin.octaveNoise0_1(x / fx, z / fz, 8);
+        return f * MAX_HEIGHT;
+    }
+
+    // returns the change counter of the generated coords
+    unsigned int getVersion() {
+        return version;
+    }
+
+    // returns true if genCoords would produce different coords for worldPos
+    bool isDirty(glm::vec3 worldPos) {
+        return version == 0
+            || squareStart(worldPos.x) != lastXStart || squareEnd(worldPos.x) != lastXEnd
+            || squareStart(worldPos.z) != lastZStart || squareEnd(worldPos.z) != lastZEnd;
+    }
+
+    // generate world space coords of the blocks in the square around worldPos.
+    // @param worldPos the center of the square
+    // @param coords receives the coords, reserved to maxCoords() so reusing it never reallocates
+    void genCoords(glm::vec3 worldPos, std::vector<glm::vec4> &coords) {
+        coords.clear();
+        if (coords.capacity() < maxCoords()) {
+            coords.reserve(maxCoords());
+        }
+
+        int xStart = squareStart(worldPos.x);
+        int xEnd = squareEnd(worldPos.x);
+        int zStart = squareStart(worldPos.z);
+        int zEnd = squareEnd(worldPos.z);
+        lastXStart = xStart;
+        lastXEnd = xEnd;
+        lastZStart = zStart;
+        lastZEnd = zEnd;
+        ++version;
 
 		for (int z = zStart; z < zEnd; ++z) {
 			for (int x = xStart; x < xEnd; ++x) {
-                coords.emplace_back(glm::vec4( x,  0.0f,  z,  0));
-                float f = perlin.octaveNoise0_1(x / fx, z / fz, 8);
-                int height = f * 5;
-                
-                for (int h = 1; h <= height; ++h) {
-                    if (h = height) {
-                        coords.emplace_back(glm::vec4( x,  h,  z,  1));
-                    } else {
-                        coords.emplace_back(glm::vec4( x,  h,  z,  0));
-                    }
-                }
+                int height = columnHeight(x, z);
+                size_t count = coords.size();
+                coords.resize(count + height + 1);
+                emitColumn(x, z, height, &coords[count]);
 			}
 		}
-        return coords;
+    }
+
+    // samples the heights of the columns of the chunk at cx, cz into scratch memory
+    int *sampleHeights(int cx, int cz, Arena &scratch) {
+        int xStart = cx * CHUNK_SIZE;
+        int zStart = cz * CHUNK_SIZE;
+        int *heights = scratch.alloc<int>(CHUNK_SIZE * CHUNK_SIZE);
+        for (int z = 0; z < CHUNK_SIZE; ++z) {
+            for (int x = 0; x < CHUNK_SIZE; ++x) {
+                heights[z * CHUNK_SIZE + x] = columnHeight(xStart + x, zStart + z);
+            }
+        }
+        return heights;
+    }
+
+    // generate the blocks of the chunk at cx, cz.
+    // @param scratch arena for the height samples, reset by the caller after the chunk
+    // @param chunk receives the blocks, cleared first so its storage is reused
+    void genChunk(int cx, int cz, Arena &scratch, Chunk &chunk) {
+        // sample the heights first so the noise loop stays free of stores into the chunk
+        int *heights = sampleHeights(cx, cz, scratch);
+
+        chunk.clear();
+        for (int z = 0; z < CHUNK_SIZE; ++z) {
+            for (int x = 0; x < CHUNK_SIZE; ++x) {
+                int height = heights[z * CHUNK_SIZE + x];
+                for (int h = 0; h < height; ++h) {
+                    chunk.set(x, h, z, block_dirt);
+                }
+                chunk.set(x, height, z, height == 0 ? block_dirt : block_grass);
+            }
+        }
+    }
+
+    // generate the blocks of the chunk at cx, cz as run-length encoded columns
+    void genChunk(int cx, int cz, Arena &scratch, RleChunk &chunk) {
+        int *heights = sampleHeights(cx, cz, scratch);
+
+        chunk.clear();
+        for (int z = 0; z < CHUNK_SIZE; ++z) {
+            for (int x = 0; x < CHUNK_SIZE; ++x) {
+                int height = heights[z * CHUNK_SIZE + x];
+                BlockRun column[2];
+                int count = 0;
+                RleChunk::append(column, count, block_dirt, height);
+                RleChunk::append(column, count, height == 0 ? block_dirt : block_grass, 1);
+                chunk.setColumn(x, z, column, count);
+            }
+        }
     }
 };
 
@@ -4,20 +4,48 @@
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 #define STB_IMAGE_IMPLEMENTATION
+// stb_image keeps the reason of a failed load in a global, which decoder threads would race on
+#define STBI_NO_FAILURE_STRINGS
 #include <includes/stb_image.h>
+#include <memorytracker.h>
+#include <trace.h>
 
+#include <atomic>
+#include <chrono>
 #include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
 
 // helper class from LearnOpenGL
 class Texture {
 private:
     unsigned int id;
+    // bytes of the image and its mipmaps accounted to the MemoryTracker
+    size_t bytes = 0;
+    // the image decode() read, until upload() hands it to GL
+    unsigned char *pixels = nullptr;
+    int width = 0;
+    int height = 0;
 
 public:
+    Texture() {}
+
+    ~Texture() {
+        stbi_image_free(pixels);
+    }
+
+    Texture(const Texture&) = delete;
+    Texture &operator=(const Texture&) = delete;
+
     void gen() {
         glGenTextures(1, &id);
     }
 
+    unsigned int getId() {
+        return id;
+    }
+
     void bind() {
         // bind so any subsequent texture commands will configure the currently bound texture
         glBindTexture(GL_TEXTURE_2D, id);
@@ -32,19 +60,132 @@ public:
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
     }
 
-    void load(const char *path) {
-        int width, height, nrChannels;
-        // load the texture
-        unsigned char *data = stbi_load(path, &width, &height, &nrChannels, 0);
-        if (data) {
+    // reads the image at path into memory without touching GL, so it can run on any thread
+    // @return false if the image couldn't be read
+    bool decode(const char *path) {
+        int nrChannels;
+        stbi_image_free(pixels);
+        pixels = stbi_load(path, &width, &height, &nrChannels, 0);
+        return pixels != nullptr;
+    }
+
+    // hands the decoded image to the bound texture and frees it, on the thread of the context
+    void upload() {
+        if (pixels) {
             // generate(target, mipmap level, format, w, h, 0, src_format, src_datatype, img_data)
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
             glGenerateMipmap(GL_TEXTURE_2D);
+            // drivers store RGB as 4 bytes per texel, the mipmaps add a third
+            MemoryTracker::instance().remove(mem_textures, bytes);
+            bytes = (size_t)width * height * 4 * 4 / 3;
+            MemoryTracker::instance().add(mem_textures, bytes);
         }
         else {
             std::cout << "Failed to load texture" << std::endl;
         }
-        stbi_image_free(data);
+        stbi_image_free(pixels);
+        pixels = nullptr;
+    }
+
+    void load(const char *path) {
+        decode(path);
+        upload();
+    }
+
+    // returns the bytes of the loaded image and its mipmaps
+    size_t memoryUsage() {
+        return bytes;
+    }
+};
+
+// class to decode the images of textures on worker threads while the main thread goes on with its
+// startup, e.g. creating the context. stb_image keeps no state between independent loads, only
+// the uploads have to wait for the context and happen on the main thread after wait()
+class TextureDecoder {
+private:
+    struct Job {
+        Texture *texture;
+        std::string path;
+    };
+
+    std::vector<Job> jobs;
+    std::atomic<size_t> next;
+    std::vector<std::thread> workers;
+    std::chrono::steady_clock::time_point startTime;
+    // when every worker ran out of images, the last of them is when decoding was done
+    std::vector<std::chrono::steady_clock::time_point> finishTimes;
+
+public:
+    TextureDecoder():next(0) {}
+
+    ~TextureDecoder() {
+        wait();
+    }
+
+    TextureDecoder(const TextureDecoder&) = delete;
+    TextureDecoder &operator=(const TextureDecoder&) = delete;
+
+    // queues the image at path for texture, call before start()
+    void add(Texture &texture, const std::string &path) {
+        Job job;
+        job.texture = &texture;
+        job.path = path;
+        jobs.push_back(job);
+    }
+
+    // decodes the queued images on threads, one per core but no more than there are images
+    // @param threads the number of threads instead, 0 for the default
+    void start(unsigned int threads = 0) {
+        if (threads == 0) {
+            threads = std::thread::hardware_concurrency();
+        }
+        if (threads > jobs.size()) {
+            threads = jobs.size();
+        }
+        if (threads == 0) {
+            threads = 1;
+        }
+        startTime = std::chrono::steady_clock::now();
+        finishTimes.assign(threads, startTime);
+        for (unsigned int t = 0; t < threads; t++) {
+            workers.push_back(std::thread([this, t]() {
+                Trace::instance().nameThread("texture decoder " + std::to_string(t));
+                for (size_t i = next++; i < jobs.size(); i = next++) {
+                    TraceScope scope("decode texture");
+                    if (!jobs[i].texture->decode(jobs[i].path.c_str())) {
+                        std::cout << "Failed to decode " << jobs[i].path << std::endl;
+                    }
+                }
+                finishTimes[t] = std::chrono::steady_clock::now();
+            }));
+        }
+    }
+
+    // returns once every queued image is decoded
+    void wait() {
+        for (size_t t = 0; t < workers.size(); t++) {
+            workers[t].join();
+        }
+        workers.clear();
+    }
+
+    size_t size() {
+        return jobs.size();
+    }
+
+    unsigned int getThreads() {
+        return finishTimes.size();
+    }
+
+    // returns the milliseconds from start() until the last image was decoded, valid after wait()
+    double getDecodeMs() {
+        std::chrono::steady_clock::time_point end = startTime;
+        for (size_t t = 0; t < finishTimes.size(); t++) {
+            if (finishTimes[t] > end) {
+                end = finishTimes[t];
+            }
+        }
+        return std::chrono::duration<double, std::milli>(end - startTime).count();
     }
 };
 
@@ -0,0 +1,183 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+// an event of the trace, names point to string literals
+struct TraceEvent {
+    char phase;
+    const char *name;
+    int thread;
+    double timestamp;
+    int argCount;
+    const char *argNames[2];
+    long long argValues[2];
+};
+
+// class to record begin/end events of any thread into a Chrome trace event file, which
+// about:tracing and Perfetto open as a timeline. recording costs a relaxed load while off
+class Trace {
+private:
+    std::atomic<bool> enabled;
+    std::mutex mutex;
+    std::vector<TraceEvent> events;
+    std::vector<std::pair<int, std::string> > threadNames;
+    std::string path;
+    std::chrono::steady_clock::time_point startTime;
+    std::atomic<int> nextThread;
+
+    Trace():enabled(false), nextThread(1) {}
+
+    // returns a small id of the calling thread, handed out in the order threads first trace
+    int threadId() {
+        static thread_local int id = 0;
+        if (id == 0) {
+            id = nextThread++;
+        }
+        return id;
+    }
+
+    static void writeString(std::ostream &out, const char *text) {
+        out << '"';
+        for (const char *c = text; *c; c++) {
+            if (*c == '"' || *c == '\\') {
+                out << '\\';
+            }
+            out << *c;
+        }
+        out << '"';
+    }
+
+public:
+    static Trace &instance() {
+        static Trace trace;
+        return trace;
+    }
+
+    Trace(const Trace&) = delete;
+    Trace &operator=(const Trace&) = delete;
+
+    // starts recording, the events are written to path by stop()
+    void start(const std::string &path) {
+        std::lock_guard<std::mutex> lock(mutex);
+        this->path = path;
+        events.clear();
+        events.reserve(1 << 16);
+        startTime = std::chrono::steady_clock::now();
+        enabled.store(true, std::memory_order_relaxed);
+    }
+
+    bool isEnabled() {
+        return enabled.load(std::memory_order_relaxed);
+    }
+
+    // records an event of the calling thread, phase B begins a scope, E ends it, i marks an instant
+    void record(char phase, const char *name, int argCount = 0, const char *argName0 = nullptr, long long argValue0 = 0,
+            const char *argName1 = nullptr, long long argValue1 = 0) {
+        if (!isEnabled()) {
+            return;
+        }
+        TraceEvent event;
+        event.phase = phase;
+        event.name = name;
+        event.thread = threadId();
+        event.timestamp = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - startTime).count();
+        event.argCount = argCount;
+        event.argNames[0] = argName0;
+        event.argValues[0] = argValue0;
+        event.argNames[1] = argName1;
+        event.argValues[1] = argValue1;
+        std::lock_guard<std::mutex> lock(mutex);
+        events.push_back(event);
+    }
+
+    // names the calling thread in the timeline
+    void nameThread(const std::string &name) {
+        if (!isEnabled()) {
+            return;
+        }
+        int id = threadId();
+        std::lock_guard<std::mutex> lock(mutex);
+        threadNames.push_back(std::make_pair(id, name));
+    }
+
+    // stops recording and writes the trace file
+    // @return false if the file couldn't be written
+    bool stop() {
+        if (!isEnabled()) {
+            return true;
+        }
+        enabled.store(false, std::memory_order_relaxed);
+        std::lock_guard<std::mutex> lock(mutex);
+        std::ofstream out(path.c_str());
+        out << "{\"traceEvents\":[\n";
+        for (size_t i = 0; i < threadNames.size(); i++) {
+            out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << threadNames[i].first
+                << ",\"args\":{\"name\":";
+            writeString(out, threadNames[i].second.c_str());
+            out << "}},\n";
+        }
+        for (size_t i = 0; i < events.size(); i++) {
+            const TraceEvent &event = events[i];
+            out << "{\"name\":";
+            writeString(out, event.name);
+            out << ",\"ph\":\"" << event.phase << "\",\"ts\":" << std::fixed << event.timestamp
+                << ",\"pid\":1,\"tid\":" << event.thread;
+            if (event.phase == 'i') {
+                // instants span all threads, like frame markers
+                out << ",\"s\":\"g\"";
+            }
+            if (event.argCount > 0) {
+                out << ",\"args\":{";
+                for (int a = 0; a < event.argCount; a++) {
+                    out << (a ? "," : "");
+                    writeString(out, event.argNames[a]);
+                    out << ":" << event.argValues[a];
+                }
+                out << "}";
+            }
+            out << "}" << (i + 1 < events.size() ? ",\n" : "\n");
+        }
+        out << "],\"displayTimeUnit\":\"ms\"}\n";
+        events.clear();
+        threadNames.clear();
+        if (!out) {
+            std::cout << "Failed to write trace " << path << std::endl;
+            return false;
+        }
+        return true;
+    }
+};
+
+// records a scope of the calling thread from construction to destruction,
+// optionally with up to two integer args such as chunk coords
+class TraceScope {
+private:
+    const char *name;
+
+public:
+    TraceScope(const char *name):name(name) {
+        Trace::instance().record('B', name);
+    }
+
+    TraceScope(const char *name, const char *argName0, long long argValue0, const char *argName1, long long argValue1)
+        :name(name) {
+        Trace::instance().record('B', name, 2, argName0, argValue0, argName1, argValue1);
+    }
+
+    ~TraceScope() {
+        Trace::instance().record('E', name);
+    }
+
+    TraceScope(const TraceScope&) = delete;
+    TraceScope &operator=(const TraceScope&) = delete;
+};
+
+#endif
@@ -8,18 +8,37 @@
 #include <shader.h>
 #include <texture.h>
 #include <terraingen.h>
+#include <world.h>
 #include <camera.h>
-
+#include <replay.h>
+#include <image.h>
+#include <profiler.h>
+#include <trace.h>
+#include <hud.h>
+#include <memorytracker.h>
+#include <drawlist.h>
+#include <meshbuffer.h>
+#include <mesher.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
 #include <iostream>
 #include <vector>
 #include <string>
+#include <memory>
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
-void processInput(GLFWwindow *window);
+void window_refresh_callback(GLFWwindow* window);
+int processInput(GLFWwindow *window);
 
 // settings
 const unsigned int SCR_WIDTH = 800;
 const unsigned int SCR_HEIGHT = 600;
+// seconds per frame when replaying a camera path
+const float REPLAY_TIMESTEP = 1.0f / 60.0f;
+// frames shown in the frame time graph of the HUD
+const int HUD_GRAPH_FRAMES = 120;
 
 // camera
 Camera camera(glm::vec3(0.0f, 6.0f, 0.0f),
@@ -29,37 +48,181 @@ Camera camera(glm::vec3(0.0f, 6.0f, 0.0f),
 // view matrix: move the scene backwards
 glm::mat4 view;
 
+// set when the window contents have to be redrawn even though nothing moved
+bool frameDirty = true;
+
 static void error_callback(int error, const char* description) {
     fprintf(stderr, "Error: %s\n", description);
 }
 
-// initializes the VBO and VAO according to vertex attributes
-void initVBOVAO(unsigned int *VBO, unsigned int *VAO, float vertices[], int size) {
-    // initialize vertex buffer object
-    glGenBuffers(1, VBO);
-    // initialize vertex array object
-    glGenVertexArrays(1, VAO);
-    // bind vertex array object
-    glBindVertexArray(*VAO);
-    // bind newly created buffer with GL_ARRAY_BUFFER
-    glBindBuffer(GL_ARRAY_BUFFER, *VBO);  
-    // copies the previously defined vertex data into buffer's memory
-    glBufferData(GL_ARRAY_BUFFER, size, vertices, GL_STATIC_DRAW);
-    // position attribute
-    // how to interpret vertex data
-    // ----------------------------
-    // (attribute, size of attr, type of data, normalize, stride (space between consecutive vertex attribute sets), offset)
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(0);
-    // texture coord attribute
-    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)(3 * sizeof(float)));
-    glEnableVertexAttribArray(1);
+// finds the directions of every loaded chunk that have faces looking at eye, a bit per mesh_face
+// @param cullFaces false to keep every direction
+// @return true if the directions of any chunk changed, so the draw list has to be rebuilt
+bool findVisibleFaces(const std::vector<WorldChunk> &chunks, glm::vec3 eye, bool cullFaces, std::vector<unsigned char> &visible) {
+    bool changed = visible.size() != chunks.size();
+    visible.resize(chunks.size());
+    for (unsigned int c = 0; c < chunks.size(); c++) {
+        unsigned char faces = 0;
+        for (int f = 0; f < mesh_face_count; f++) {
+            if (!cullFaces || !chunks[c].mesh->facesAway(f, eye.x, eye.y, eye.z)) {
+                faces |= 1 << f;
+            }
+        }
+        changed = changed || visible[c] != faces;
+        visible[c] = faces;
+    }
+    return changed;
 }
 
+// rebuilds the draws of the meshes of the loaded chunks, one per material and visible direction
+// of every chunk. they still have to be sorted for the camera
+// @param visible the directions of every chunk to draw, from findVisibleFaces()
+void buildDrawList(const std::vector<WorldChunk> &chunks, MeshBuffer &meshes, const unsigned int materials[],
+        const std::vector<unsigned char> &visible, DrawList &drawList) {
+    drawList.clear();
+    for (unsigned int c = 0; c < chunks.size(); c++) {
+        const MeshRange *range = meshes.find(chunks[c].cx, chunks[c].cz);
+        if (range == nullptr) {
+            continue;
+        }
+        float half = Terrain::CHUNK_SIZE / 2.0f;
+        glm::vec3 center(chunks[c].cx * Terrain::CHUNK_SIZE + half, Terrain::MAX_HEIGHT / 2.0f, chunks[c].cz * Terrain::CHUNK_SIZE + half);
+        for (int f = 0; f < mesh_face_count; f++) {
+            if (!(visible[c] & 1 << f)) {
+                continue;
+            }
+            for (int m = 0; m < mesh_material_count; m++) {
+                drawList.add(materials[m], range->groupFirst[m][f], range->groupCount[m][f], range->baseVertex, center);
+            }
+        }
+    }
+}
 int main(int argc, char** argv) {
+    // command line: [--idle] [--world dir] [--codec name] [--hot-cache MiB] [--warm-cache MiB] [width] [seed]
+    // --idle stops rendering and sleeps until input arrives while nothing changes
+    // --world loads chunks from and saves them to the region files in dir
+    // --codec compresses the chunks saved to dir with the named codec
+    // --hot-cache and --warm-cache set the budgets of the decoded and compressed chunks kept in memory
+    // --replay moves the camera along a path file at a fixed timestep in a hidden window and reports
+    //   the frame times, --frames sets how many frames to replay (default the length of the path)
+    // --record writes the keys pressed in every frame to a path file on exit
+    // --headless renders --frames frames (default 1, or the replay) into an offscreen framebuffer of
+    //   a hidden window and prints the hash of the last frame, --png also writes it to a file
+    // --trace records the frame loop and chunk work into a Chrome trace event file
+    // --hud shows the performance overlay from the start, H toggles it
+    // --load-budget fetches at most n chunks per frame, spreading the work of entering new terrain
+    // --depth-prepass draws the chunks into the depth buffer first and shades only the visible
+    //   fragments in a second pass testing GL_EQUAL, P toggles it
+    // --no-multidraw issues a draw call per chunk and material instead of one multi-draw per material
+    // --no-cull draws the back faces of blocks too, the frame must hash the same as with culling.
+    //   with culling the directions of a chunk that face away from the camera aren't even submitted
+    // --memory-budget caps the MiB of a tracked subsystem, the chunk cache evicts to stay under the
+    //   terrain, mesh and caches budgets. the current and peak use is on the HUD and in the batch report
+    // --rle-chunks keeps the loaded chunks as runs of blocks in every column and meshes them from
+    //   the runs, the frame must hash the same as with sections
+    bool idle = false;
+    bool headless = false;
+    std::string pngFile;
+    std::string traceFile;
+    bool showHud = false;
+    bool multiDraw = true;
+    bool depthPrepass = false;
+    bool cullFaces = true;
+    chunk_format format = chunk_sections;
+    int loadBudget = 0;
+    std::string worldDir;
+    std::string replayFile;
+    std::string recordFile;
+    size_t replayFrames = 0;
+    std::string codecName = "rle";
+    size_t hotBudget = World::DEFAULT_HOT_BUDGET;
+    size_t warmBudget = World::DEFAULT_WARM_BUDGET;
+    std::vector<std::string> args;
+    for (int i = 1; i < argc; i++) {
+        std::string arg(argv[i]);
+        if (arg == "--idle") {
+            idle = true;
+        } else if (arg == "--world" && i + 1 < argc) {
+            worldDir = argv[++i];
+        } else if (arg == "--codec" && i + 1 < argc) {
+            codecName = argv[++i];
+        } else if (arg == "--hot-cache" && i + 1 < argc) {
+            hotBudget = (size_t)std::stoi(argv[++i]) << 20;
+        } else if (arg == "--warm-cache" && i + 1 < argc) {
+            warmBudget = (size_t)std::stoi(argv[++i]) << 20;
+        } else if (arg == "--replay" && i + 1 < argc) {
+            replayFile = argv[++i];
+        } else if (arg == "--record" && i + 1 < argc) {
+            recordFile = argv[++i];
+        } else if (arg == "--headless") {
+            headless = true;
+        } else if (arg == "--png" && i + 1 < argc) {
+            pngFile = argv[++i];
+        } else if (arg == "--trace" && i + 1 < argc) {
+            traceFile = argv[++i];
+        } else if (arg == "--hud") {
+            showHud = true;
+        } else if (arg == "--depth-prepass") {
+            depthPrepass = true;
+        } else if (arg == "--no-multidraw") {
+            multiDraw = false;
+        } else if (arg == "--no-cull") {
+            cullFaces = false;
+        } else if (arg == "--rle-chunks") {
+            format = chunk_runs;
+        } else if (arg == "--load-budget" && i + 1 < argc) {
+            loadBudget = std::stoi(argv[++i]);
+        } else if (arg == "--memory-budget" && i + 2 < argc) {
+            MemoryTag tag;
+            if (!MemoryTracker::fromName(argv[++i], tag)) {
+                std::cout << "Unknown memory tag " << argv[i] << std::endl;
+                return -1;
+            }
+            MemoryTracker::instance().setBudget(tag, (size_t)std::stoi(argv[++i]) << 20);
+        } else if (arg == "--frames" && i + 1 < argc) {
+            replayFrames = std::stoi(argv[++i]);
+        } else {
+            args.push_back(arg);
+        }
+    }
+
+    if (!traceFile.empty()) {
+        Trace::instance().start(traceFile);
+        Trace::instance().nameThread("main");
+    }
+
+    bool replaying = !replayFile.empty();
+    CameraPath path;
+    if (replaying) {
+        if (!path.load(replayFile)) {
+            return -1;
+        }
+        if (replayFrames == 0) {
+            replayFrames = path.size();
+        }
+    }
+    // replays and headless runs step a fixed number of frames at a fixed timestep
+    bool batch = replaying || headless;
+    if (headless && replayFrames == 0) {
+        replayFrames = 1;
+    }
+
+    // the block textures decode on worker threads while the window and the context are created,
+    // their uploads wait for the context
+    std::chrono::steady_clock::time_point startupStart = std::chrono::steady_clock::now();
+    Texture dirt;
+    Texture grass_side;
+    Texture grass_top;
+    TextureDecoder textureDecoder;
+    textureDecoder.add(dirt, FileSystem::getPath("source/textures/dirt.png"));
+    textureDecoder.add(grass_side, FileSystem::getPath("source/textures/grass_side.png"));
+    textureDecoder.add(grass_top, FileSystem::getPath("source/textures/grass_top.png"));
+    textureDecoder.start();
+
     glfwSetErrorCallback(error_callback);
 
-    if (!glfwInit()) exit(EXIT_FAILURE);
+    // returning instead of exit() destroys the texture decoder, which joins its threads
+    if (!glfwInit()) return EXIT_FAILURE;
     // glfw: initialize and configure
     // ------------------------------
     glfwInit();
@@ -70,6 +233,10 @@ int main(int argc, char** argv) {
 #ifdef __APPLE__
     glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE); // uncomment this statement to fix compilation on OS X
 #endif
+    // replays render into a hidden window so they run the same on a desktop or a virtual display
+    if (batch) {
+        glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    }
 
     // glfw window creation
     // --------------------
@@ -82,6 +249,11 @@ int main(int argc, char** argv) {
     }
     glfwMakeContextCurrent(window);
     glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+    glfwSetWindowRefreshCallback(window, window_refresh_callback);
+    // replays measure the frame loop, not the refresh rate of the display
+    if (batch) {
+        glfwSwapInterval(0);
+    }
 
     // glad: load all OpenGL function pointers
     // ---------------------------------------
@@ -94,160 +266,87 @@ int main(int argc, char** argv) {
     // configure global opengl state
     // -----------------------------
     glEnable(GL_DEPTH_TEST);
+    // block faces wind counter-clockwise seen from outside, the ones facing away are never seen
+    if (cullFaces) {
+        glEnable(GL_CULL_FACE);
+        glCullFace(GL_BACK);
+        glFrontFace(GL_CCW);
+    }
 
     // build and compile our shader zprogram
     // ------------------------------------
     Shader ourShader(FileSystem::getPath("source/shaders/vertex.vs").c_str(), FileSystem::getPath("source/shaders/fragment.fs").c_str());
-
-    // set up vertex data 
-    // ------------------
-    float vertices[] = {
-        -0.5f, -0.5f, -0.5f,  0.0f, 0.0f,
-        0.5f, -0.5f, -0.5f,  1.0f, 0.0f,
-        0.5f,  0.5f, -0.5f,  1.0f, 1.0f,
-        0.5f,  0.5f, -0.5f,  1.0f, 1.0f,
-        -0.5f,  0.5f, -0.5f,  0.0f, 1.0f,
-        -0.5f, -0.5f, -0.5f,  0.0f, 0.0f,
-
-        -0.5f, -0.5f,  0.5f,  0.0f, 0.0f,
-        0.5f, -0.5f,  0.5f,  1.0f, 0.0f,
-        0.5f,  0.5f,  0.5f,  1.0f, 1.0f,
-        0.5f,  0.5f,  0.5f,  1.0f, 1.0f,
-        -0.5f,  0.5f,  0.5f,  0.0f, 1.0f,
-        -0.5f, -0.5f,  0.5f,  0.0f, 0.0f,
-
-        -0.5f,  0.5f,  0.5f,  1.0f, 0.0f,
-        -0.5f,  0.5f, -0.5f,  1.0f, 1.0f,
-        -0.5f, -0.5f, -0.5f,  0.0f, 1.0f,
-        -0.5f, -0.5f, -0.5f,  0.0f, 1.0f,
-        -0.5f, -0.5f,  0.5f,  0.0f, 0.0f,
-        -0.5f,  0.5f,  0.5f,  1.0f, 0.0f,
-
-        0.5f,  0.5f,  0.5f,  1.0f, 0.0f,
-        0.5f,  0.5f, -0.5f,  1.0f, 1.0f,
-        0.5f, -0.5f, -0.5f,  0.0f, 1.0f,
-        0.5f, -0.5f, -0.5f,  0.0f, 1.0f,
-        0.5f, -0.5f,  0.5f,  0.0f, 0.0f,
-        0.5f,  0.5f,  0.5f,  1.0f, 0.0f,
-
-        -0.5f, -0.5f, -0.5f,  0.0f, 1.0f,
-        0.5f, -0.5f, -0.5f,  1.0f, 1.0f,
-        0.5f, -0.5f,  0.5f,  1.0f, 0.0f,
-        0.5f, -0.5f,  0.5f,  1.0f, 0.0f,
-        -0.5f, -0.5f,  0.5f,  0.0f, 0.0f,
-        -0.5f, -0.5f, -0.5f,  0.0f, 1.0f,
-
-        -0.5f,  0.5f, -0.5f,  0.0f, 1.0f,
-        0.5f,  0.5f, -0.5f,  1.0f, 1.0f,
-        0.5f,  0.5f,  0.5f,  1.0f, 0.0f,
-        0.5f,  0.5f,  0.5f,  1.0f, 0.0f,
-        -0.5f,  0.5f,  0.5f,  0.0f, 0.0f,
-        -0.5f,  0.5f, -0.5f,  0.0f, 1.0f
-    };
-
-    float sides[] = {
-        -0.5f, -0.5f, -0.5f, 0.0f, 0.0f,
-        0.5f, -0.5f, -0.5f,  -1.0f, 0.0f,
-        0.5f,  0.5f, -0.5f,  -1.0f, -1.0f,
-        0.5f,  0.5f, -0.5f,  -1.0f, -1.0f,
-        -0.5f,  0.5f, -0.5f,  0.0f, -1.0f,
-        -0.5f, -0.5f, -0.5f,  0.0f, 0.0f,
-
-        -0.5f, -0.5f,  0.5f,  0.0f, 0.0f,
-        0.5f, -0.5f,  0.5f,  -1.0f, 0.0f,
-        0.5f,  0.5f,  0.5f,  -1.0f, -1.0f,
-        0.5f,  0.5f,  0.5f,  -1.0f, -1.0f,
-        -0.5f,  0.5f,  0.5f,  0.0f, -1.0f,
-        -0.5f, -0.5f,  0.5f,  0.0f, 0.0f,
-
-        -0.5f,  0.5f,  0.5f,  0.0f, 0.0f,
-        -0.5f,  0.5f, -0.5f,  1.0f, 0.0f,
-        -0.5f, -0.5f, -0.5f,  1.0f, 1.0f,
-        -0.5f, -0.5f, -0.5f,  1.0f, 1.0f,
-        -0.5f, -0.5f,  0.5f,  0.0f, 1.0f,
-        -0.5f,  0.5f,  0.5f,  0.0f, 0.0f,
-
-        0.5f,  0.5f,  0.5f,  0.0f, 0.0f,
-        0.5f,  0.5f, -0.5f,  1.0f, 0.0f,
-        0.5f, -0.5f, -0.5f,  1.0f, 1.0f,
-        0.5f, -0.5f, -0.5f,  1.0f, 1.0f,
-        0.5f, -0.5f,  0.5f,  0.0f, 1.0f,
-        0.5f,  0.5f,  0.5f,  0.0f, 0.0f,
-    };
-
-    float bottom[] {
-        // bottom
-        -0.5f, -0.5f, -0.5f,  0.0f, 1.0f,
-        0.5f, -0.5f, -0.5f,  1.0f, 1.0f,
-        0.5f, -0.5f,  0.5f,  1.0f, 0.0f,
-        0.5f, -0.5f,  0.5f,  1.0f, 0.0f,
-        -0.5f, -0.5f,  0.5f,  0.0f, 0.0f,
-        -0.5f, -0.5f, -0.5f,  0.0f, 1.0f,
-    };
-
-    float top[] {
-        // top
-        -0.5f,  0.5f, -0.5f,  0.0f, 1.0f,
-        0.5f,  0.5f, -0.5f,  1.0f, 1.0f,
-        0.5f,  0.5f,  0.5f,  1.0f, 0.0f,
-        0.5f,  0.5f,  0.5f,  1.0f, 0.0f,
-        -0.5f,  0.5f,  0.5f,  0.0f, 0.0f,
-        -0.5f,  0.5f, -0.5f,  0.0f, 1.0f
-    };
+    // positions only, for the depth pre-pass
+    Shader depthShader(FileSystem::getPath("source/shaders/depth.vs").c_str(), FileSystem::getPath("source/shaders/depth.fs").c_str());
 
     // world space positions of our cubes
     Terrain terrain;
-    std::vector<glm::vec4> cubePositions;
-    if (argc == 1) {
+    DrawList drawList;
+    // directions of every loaded chunk in the draw list
+    std::vector<unsigned char> visibleFaces;
+    if (args.size() == 0) {
         terrain = Terrain();
-    } else if (argc == 2) {
-        std::string arg1(argv[1]);
-        terrain = Terrain(stoi(arg1));
-    } else if (argc == 3) {
-        std::string arg1(argv[1]);
-        std::string arg2(argv[2]);
-        terrain = Terrain(stoi(arg1), stoi(arg2));
+    } else if (args.size() == 1) {
+        terrain = Terrain(stoi(args[0]));
+    } else if (args.size() == 2) {
+        terrain = Terrain(stoi(args[0]), stoi(args[1]));
     }
-    cubePositions = terrain.genCoords(camera.getPos());
-
-    // set up VBO, VAO
-    // ---------------
-    unsigned int VBO, VAO;
-    initVBOVAO(&VBO, &VAO, vertices, sizeof(vertices));
-
-    // now do the same for sides, top
-    unsigned int VBO_SIDES, VAO_SIDES;
-    initVBOVAO(&VBO_SIDES, &VAO_SIDES, sides, sizeof(sides));
-    
-    unsigned int VBO_TOP, VAO_TOP;
-    initVBOVAO(&VBO_TOP, &VAO_TOP, top, sizeof(top));
+    // chunks are generated around the camera as it moves, the draw list is sized
+    // once so rebuilding it never allocates
+    std::unique_ptr<RegionStore> store;
+    if (!worldDir.empty()) {
+        const Codec *codec = findCodec(codecName);
+        if (codec == nullptr) {
+            std::cout << "Unknown codec " << codecName << std::endl;
+            return -1;
+        }
+        store.reset(new RegionStore(worldDir, terrain.getSeed(), terrain.getWidth(), codec));
+    }
+    World world(terrain, store.get(), hotBudget, warmBudget, format);
+    world.setLoadBudget(loadBudget);
+    drawList.reserve(world.maxChunks() * mesh_material_count * mesh_face_count);
+    visibleFaces.reserve(world.maxChunks());
+    MemoryTracker::instance().add(mem_mesh, drawList.capacity() * sizeof(DrawItem));
 
-    // create textures 1, 2, 3
+    // create textures 1, 2, 3 from the decoded images, uploaded together
     // -----------------------
-    Texture dirt;
-    dirt.gen();
-    dirt.bind();
-    dirt.setOptions();
-    dirt.load(FileSystem::getPath("source/textures/dirt.png").c_str());
-
-    Texture grass_side;
-    grass_side.gen();
-    grass_side.bind();
-    grass_side.setOptions();
-    grass_side.load(FileSystem::getPath("source/textures/grass_side.png").c_str());
-
-    Texture grass_top;
-    grass_top.gen();
-    grass_top.bind();
-    grass_top.setOptions();
-    grass_top.load(FileSystem::getPath("source/textures/grass_top.png").c_str());
+    textureDecoder.wait();
+    std::chrono::steady_clock::time_point uploadStart = std::chrono::steady_clock::now();
+    {
+        TraceScope scope("upload textures");
+        Texture *textures[] = { &dirt, &grass_side, &grass_top };
+        for (Texture *texture : textures) {
+            texture->gen();
+            texture->bind();
+            texture->setOptions();
+            texture->upload();
+        }
+    }
+    std::chrono::duration<double, std::milli> uploadTime = std::chrono::steady_clock::now() - uploadStart;
+
+    // what the draw list binds for every kind of block, the sort groups draws of the same one
+    // the meshes of the loaded chunks share a vertex and an index buffer, so drawing them
+    // only binds a texture per material
+    MeshBuffer meshes;
+    meshes.init();
+    unsigned int materials[mesh_material_count];
+    DrawMaterial material;
+    material.program = ourShader.ID;
+    material.vao = meshes.getVAO();
+    material.texture = dirt.getId();
+    materials[mesh_dirt] = drawList.addMaterial(material);
+    material.texture = grass_side.getId();
+    materials[mesh_grass_side] = drawList.addMaterial(material);
+    material.texture = grass_top.getId();
+    materials[mesh_grass_top] = drawList.addMaterial(material);
+    // skips binding what the last draw left bound
+    GlStateCache state;
 
     // activate shader before setting uniforms
     ourShader.use();
 
-    // model matrix: rotate around all axes
+    // model matrix: chunk meshes are in world space already
     glm::mat4 model;
-    model = glm::rotate(model, (float)glfwGetTime() * glm::radians(50.0f), glm::vec3(0.5f, 1.0f, 0.0f));
 
     // note that we're translating the scene in the reverse direction of where we want to move
     view = camera.getViewMatrix(); 
@@ -265,77 +364,296 @@ int main(int argc, char** argv) {
     glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
     // (do not need to be set each frame)
     glUniformMatrix4fv(projectionLoc, 1, GL_FALSE, glm::value_ptr(projection));
+    depthShader.use();
+    unsigned int depthViewLoc = glGetUniformLocation(depthShader.ID, "view");
+    glUniformMatrix4fv(glGetUniformLocation(depthShader.ID, "model"), 1, GL_FALSE, glm::value_ptr(model));
+    glUniformMatrix4fv(depthViewLoc, 1, GL_FALSE, glm::value_ptr(view));
+    glUniformMatrix4fv(glGetUniformLocation(depthShader.ID, "projection"), 1, GL_FALSE, glm::value_ptr(projection));
+
+    // headless frames go to a framebuffer of our own, the contents of a hidden window are undefined
+    unsigned int offscreenFBO = 0, offscreenColor = 0, offscreenDepth = 0;
+    if (headless) {
+        glGenFramebuffers(1, &offscreenFBO);
+        glBindFramebuffer(GL_FRAMEBUFFER, offscreenFBO);
+        glGenRenderbuffers(1, &offscreenColor);
+        glBindRenderbuffer(GL_RENDERBUFFER, offscreenColor);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, SCR_WIDTH, SCR_HEIGHT);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, offscreenColor);
+        glGenRenderbuffers(1, &offscreenDepth);
+        glBindRenderbuffer(GL_RENDERBUFFER, offscreenDepth);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, SCR_WIDTH, SCR_HEIGHT);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, offscreenDepth);
+        // 4 bytes per pixel of color and of depth and stencil
+        MemoryTracker::instance().add(mem_textures, SCR_WIDTH * SCR_HEIGHT * 8);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+            std::cout << "Failed to create offscreen framebuffer" << std::endl;
+            glfwTerminate();
+            return -1;
+        }
+        glViewport(0, 0, SCR_WIDTH, SCR_HEIGHT);
+    }
+
+    // CPU and GPU time of the render passes
+    FrameProfiler profiler;
+    profiler.init();
+    int clearPass = profiler.addPass("clear");
+    int terrainPass = profiler.addPass("terrain opaque");
+    // the terrain drawn with --depth-prepass, timed apart so the two modes can be compared
+    int prepassPass = profiler.addPass("depth prepass");
+    int equalPass = profiler.addPass("terrain after prepass");
+    int hudPass = profiler.addPass("hud");
+
+    // performance overlay, drawn after the terrain with its own shader and timed as a pass of its own
+    Hud hud(FileSystem::getPath("source/shaders/hud.vs").c_str(), FileSystem::getPath("source/shaders/hud.fs").c_str());
+    float frameTimes[HUD_GRAPH_FRAMES] = { 0.0f };
+    size_t frameTimeIndex = 0;
+    bool hudKeyDown = false;
+    bool prepassKeyDown = false;
+    std::chrono::steady_clock::time_point lastFrameStart = std::chrono::steady_clock::now();
+    std::chrono::duration<double, std::milli> startupTime = lastFrameStart - startupStart;
+    std::cout << "started in " << startupTime.count() << " ms, " << textureDecoder.size() << " textures decoded in "
+              << textureDecoder.getDecodeMs() << " ms on " << textureDecoder.getThreads() << " threads and uploaded in "
+              << uploadTime.count() << " ms" << std::endl;
 
     // uncomment this call to draw in wireframe polygons.
     //glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
 
     // render loop
     // -----------
+    unsigned int drawnCameraVersion = camera.getVersion();
+    CameraPath recorded;
+    FrameStats frameStats;
+    frameStats.reserve(replayFrames);
+    size_t frame = 0;
     while (!glfwWindowShouldClose(window)) {
+        std::chrono::steady_clock::time_point frameStart = std::chrono::steady_clock::now();
+        Trace::instance().record('i', "frame", 1, "frame", frame);
+
+        frameTimes[frameTimeIndex] = std::chrono::duration<float, std::milli>(frameStart - lastFrameStart).count();
+        frameTimeIndex = (frameTimeIndex + 1) % HUD_GRAPH_FRAMES;
+        lastFrameStart = frameStart;
+
         // per-frame time logic
         // --------------------
-        float currentFrame = glfwGetTime();
+        float currentFrame = batch ? frame * REPLAY_TIMESTEP : glfwGetTime();
         camera.updateDelta(currentFrame);
 
         // input
         // -----
-        processInput(window);
+        if (batch) {
+            if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS) {
+                glfwSetWindowShouldClose(window, true);
+            }
+            int key = path.keyAt(frame);
+            if (key != key_none) {
+                camera.processKeyboardInput((keyboard_input)key);
+            }
+        } else {
+            int key = processInput(window);
+            if (!recordFile.empty()) {
+                recorded.record(key);
+            }
+        }
+        bool hudKey = glfwGetKey(window, GLFW_KEY_H) == GLFW_PRESS;
+        if (hudKey && !hudKeyDown) {
+            showHud = !showHud;
+            frameDirty = true;
+        }
+        hudKeyDown = hudKey;
+        bool prepassKey = glfwGetKey(window, GLFW_KEY_P) == GLFW_PRESS;
+        if (prepassKey && !prepassKeyDown) {
+            depthPrepass = !depthPrepass;
+            frameDirty = true;
+        }
+        prepassKeyDown = prepassKey;
+
+        // update terrain information, the draw list is reused until the loaded chunks change
+        if (world.update(camera.getPos())) {
+            TraceScope scope("build draw list");
+            meshes.sync(world.getChunks());
+            findVisibleFaces(world.getChunks(), camera.getPos(), cullFaces, visibleFaces);
+            buildDrawList(world.getChunks(), meshes, materials, visibleFaces, drawList);
+            drawList.sort(camera.getPos());
+            frameDirty = true;
+        }
+
+        // update view information
+        if (camera.getVersion() != drawnCameraVersion) {
+            view = camera.getViewMatrix();
+            state.useProgram(ourShader.ID);
+            glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
+            state.useProgram(depthShader.ID);
+            glUniformMatrix4fv(depthViewLoc, 1, GL_FALSE, glm::value_ptr(view));
+            drawnCameraVersion = camera.getVersion();
+            frameDirty = true;
+            // opaque chunks front to back, so the near ones fill the depth buffer first. the draws
+            // only change when the camera crosses the plane of a direction of some chunk
+            TraceScope scope("sort draw list");
+            if (findVisibleFaces(world.getChunks(), camera.getPos(), cullFaces, visibleFaces)) {
+                buildDrawList(world.getChunks(), meshes, materials, visibleFaces, drawList);
+            }
+            drawList.sort(camera.getPos());
+        }
+
+        // nothing changed since the last frame: sleep until an event arrives
+        if (idle && !frameDirty && !batch) {
+            glfwWaitEvents();
+            // don't count the time spent asleep as movement time
+            camera.updateDelta(glfwGetTime());
+            continue;
+        }
+        frameDirty = false;
 
         // render
         // ------
+        TraceScope renderScope("render");
+        profiler.beginFrame();
+        profiler.begin(clearPass);
         glClearColor(0.5f, 0.7f, 1.0f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT); // also clear the depth buffer now!
-
-        // update view information
-        view = camera.getViewMatrix();
-        unsigned int viewLoc  = glGetUniformLocation(ourShader.ID, "view");
-        glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-
-        // update terrain information
-        cubePositions = terrain.genCoords(camera.getPos());
-
-        // draw each block
-        int len = cubePositions.size();
-        for (unsigned int i = 0; i < len; i++) {
-            glm::mat4 model;
-            glm::vec4 translation = cubePositions[i];
-            model = glm::translate(model, glm::vec3(translation.x, translation.y, translation.z));
-            float angle = 20.0f * (i + 1.0f); 
-            unsigned int modelLoc = glGetUniformLocation(ourShader.ID, "model");
-            glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-
-            if (translation.w == 0) {
-                // not a top block
-                glBindVertexArray(VAO);
-                // bind textures on corresponding texture units
-                glActiveTexture(GL_TEXTURE0);
-                dirt.bind();
-                glDrawArrays(GL_TRIANGLES, 0, 36);
-            } else if (translation.w == 1) {
-                // is a top block
-                glBindVertexArray(VAO_SIDES);
-                glActiveTexture(GL_TEXTURE0);
-                grass_side.bind();
-                glDrawArrays(GL_TRIANGLES, 0, 24);
-                glBindVertexArray(VAO_TOP);
-                glActiveTexture(GL_TEXTURE0);
-                grass_top.bind();
-                glDrawArrays(GL_TRIANGLES, 0, 12);
+        profiler.end(clearPass);
+
+        // draw the loaded chunks
+        state.resetChanges();
+        size_t triangles = 0;
+        size_t drawCalls = 0;
+        int colorPass = depthPrepass ? equalPass : terrainPass;
+        if (depthPrepass) {
+            // lay down the nearest depth without shading, then shade only the fragments that match it
+            profiler.begin(prepassPass);
+            glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+            drawCalls += drawList.submitDepth(state, depthShader.ID, multiDraw, triangles);
+            glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+            profiler.end(prepassPass);
+            glDepthFunc(GL_EQUAL);
+            glDepthMask(GL_FALSE);
+        }
+        profiler.begin(colorPass);
+        drawCalls += drawList.submit(state, multiDraw, triangles);
+        profiler.end(colorPass);
+        if (depthPrepass) {
+            // the clear of the next frame needs depth writes back on
+            glDepthFunc(GL_LESS);
+            glDepthMask(GL_TRUE);
+        }
+        size_t stateChanges = state.getChanges();
+
+        if (showHud) {
+            profiler.begin(hudPass);
+            const std::vector<PassTiming> &passes = profiler.getPasses();
+            float lastMs = frameTimes[(frameTimeIndex + HUD_GRAPH_FRAMES - 1) % HUD_GRAPH_FRAMES];
+            ChunkCache &cache = world.getCache();
+            glm::vec4 white(1.0f), grey(0.8f, 0.8f, 0.8f, 1.0f);
+            char line[128];
+            float y = 8.0f;
+            snprintf(line, sizeof(line), "FRAME %.2f MS  %.0f FPS", lastMs, lastMs > 0.0f ? 1000.0f / lastMs : 0.0f);
+            hud.text(8.0f, y, line, white);
+            hud.graph(8.0f, y += Hud::LINE_HEIGHT, HUD_GRAPH_FRAMES * 2.0f, 40.0f, frameTimes, HUD_GRAPH_FRAMES,
+                frameTimeIndex, 33.3f, glm::vec4(0.3f, 1.0f, 0.3f, 0.9f));
+            y += 40.0f + 4.0f;
+            snprintf(line, sizeof(line), "DRAW CALLS %zu  STATE CHANGES %zu  TRIANGLES %zu", drawCalls, stateChanges, triangles);
+            hud.text(8.0f, y, line, grey);
+            snprintf(line, sizeof(line), "CHUNKS %zu VIEW  %zu HOT  %zu WARM  %zu PENDING", world.getChunks().size(),
+                cache.hotCount(), cache.warmCount(), world.getPending());
+            hud.text(8.0f, y += Hud::LINE_HEIGHT, line, grey);
+            snprintf(line, sizeof(line), "MEMORY HOT %.1f MB  WARM %.1f MB", cache.getHotBytes() / 1048576.0,
+                cache.getWarmBytes() / 1048576.0);
+            hud.text(8.0f, y += Hud::LINE_HEIGHT, line, grey);
+            // red while a subsystem is over its budget
+            MemoryTracker &memory = MemoryTracker::instance();
+            bool overBudget = false;
+            for (int t = 0; t < mem_tag_count; t++) {
+                overBudget = overBudget || memory.overBudget((MemoryTag)t);
+            }
+            snprintf(line, sizeof(line), "TERRAIN %.1f  MESH %.1f  GPU %.1f  TEX %.1f  CACHE %.1f MB",
+                memory.getCurrent(mem_terrain) / 1048576.0, memory.getCurrent(mem_mesh) / 1048576.0,
+                memory.getCurrent(mem_gpu_buffers) / 1048576.0, memory.getCurrent(mem_textures) / 1048576.0,
+                memory.getCurrent(mem_caches) / 1048576.0);
+            hud.text(8.0f, y += Hud::LINE_HEIGHT, line, overBudget ? glm::vec4(1.0f, 0.3f, 0.3f, 1.0f) : grey);
+            if (profiler.isGpuAvailable()) {
+                snprintf(line, sizeof(line), "GPU PREPASS %.2f  TERRAIN %.2f  HUD %.2f MS", depthPrepass ? passes[prepassPass].gpuMs : 0.0,
+                    passes[colorPass].gpuMs, passes[hudPass].gpuMs);
+            } else {
+                snprintf(line, sizeof(line), "GPU TIMES UNAVAILABLE");
             }
+            hud.text(8.0f, y += Hud::LINE_HEIGHT, line, grey);
+            snprintf(line, sizeof(line), "CPU PREPASS %.2f  TERRAIN %.2f  HUD %.2f MS", depthPrepass ? passes[prepassPass].cpuMs : 0.0,
+                passes[colorPass].cpuMs, passes[hudPass].cpuMs);
+            hud.text(8.0f, y += Hud::LINE_HEIGHT, line, grey);
+            hud.text(8.0f, y += Hud::LINE_HEIGHT, depthPrepass ? "DEPTH PREPASS ON (P)" : "DEPTH PREPASS OFF (P)", grey);
+
+            int fbWidth = SCR_WIDTH, fbHeight = SCR_HEIGHT;
+            if (!headless) {
+                glfwGetFramebufferSize(window, &fbWidth, &fbHeight);
+            }
+            hud.draw(fbWidth, fbHeight);
+            // the HUD bound its own program, VAO and texture
+            state.invalidate();
+            profiler.end(hudPass);
         }
+        profiler.endFrame();
 
         // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
         // -------------------------------------------------------------------------------
-        glfwSwapBuffers(window);
+        {
+            TraceScope scope("swap buffers");
+            glfwSwapBuffers(window);
+        }
         glfwPollEvents();
+
+        if (batch) {
+            // wait for the GPU so the frame time covers the rendering too
+            glFinish();
+            std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - frameStart;
+            frameStats.addFrame(elapsed.count(), triangles, drawCalls, stateChanges);
+        }
+        if (++frame >= replayFrames && batch) {
+            break;
+        }
+    }
+    if (batch) {
+        std::cout << "rendered " << frameStats.frames() << " frames";
+        if (replaying) {
+            std::cout << " of " << replayFile;
+        }
+        std::cout << " with width " << terrain.getWidth() << std::endl;
+        frameStats.report(std::cout);
+        profiler.finish();
+        profiler.report(std::cout);
+        std::cout << "chunks: " << world.getChunksGenerated() << " generated, "
+                  << world.getChunksLoaded() << " loaded" << std::endl;
+        MemoryTracker::instance().report(std::cout);
+    }
+    Trace::instance().stop();
+    if (!recordFile.empty() && !recorded.save(recordFile)) {
+        std::cout << "Failed to write camera path " << recordFile << std::endl;
+    }
+    if (headless) {
+        // read back the last frame, flipping it since GL rows go from bottom to top
+        std::vector<unsigned char> pixels(SCR_WIDTH * SCR_HEIGHT * 4);
+        std::vector<unsigned char> flipped(pixels.size());
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        glReadPixels(0, 0, SCR_WIDTH, SCR_HEIGHT, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+        size_t rowBytes = SCR_WIDTH * 4;
+        for (unsigned int y = 0; y < SCR_HEIGHT; y++) {
+            std::copy(pixels.begin() + y * rowBytes, pixels.begin() + (y + 1) * rowBytes,
+                flipped.begin() + (SCR_HEIGHT - 1 - y) * rowBytes);
+        }
+        char hash[17];
+        snprintf(hash, sizeof(hash), "%016llx", (unsigned long long)hashPixels(flipped.data(), flipped.size()));
+        std::cout << "frame " << frame << " hash " << hash << std::endl;
+        if (!pngFile.empty() && !writePng(pngFile, flipped.data(), SCR_WIDTH, SCR_HEIGHT)) {
+            std::cout << "Failed to write " << pngFile << std::endl;
+        }
+        glDeleteRenderbuffers(1, &offscreenColor);
+        glDeleteRenderbuffers(1, &offscreenDepth);
+        glDeleteFramebuffers(1, &offscreenFBO);
+        MemoryTracker::instance().remove(mem_textures, SCR_WIDTH * SCR_HEIGHT * 8);
     }
     // de-allocate resources
-    glDeleteVertexArrays(1, &VAO);
-    glDeleteBuffers(1, &VBO);
-    glDeleteVertexArrays(1, &VAO_SIDES);
-    glDeleteBuffers(1, &VBO_SIDES);
-    glDeleteVertexArrays(1, &VAO_TOP);
-    glDeleteBuffers(1, &VBO_TOP);
+    profiler.destroy();
+    hud.destroy();
+    meshes.destroy();
 
     // glfw: terminate, clearing all previously allocated GLFW resources.
     // ------------------------------------------------------------------
@@ -344,19 +662,25 @@ int main(int argc, char** argv) {
 }
 
 // process all input: query GLFW whether relevant keys are pressed/released this frame and react accordingly
+// returns the key that moved the camera, key_none if none did
 // ---------------------------------------------------------------------------------------------------------
-void processInput(GLFWwindow *window) {
+int processInput(GLFWwindow *window) {
+    int key = key_none;
     if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS) {
         glfwSetWindowShouldClose(window, true);
     } else if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS) {
-        camera.processKeyboardInput(key_w);
+        key = key_w;
     } else if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS) {
-        camera.processKeyboardInput(key_a);
+        key = key_a;
     } else if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS) {
-        camera.processKeyboardInput(key_s);
+        key = key_s;
     } else if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS) {
-        camera.processKeyboardInput(key_d);
+        key = key_d;
+    }
+    if (key != key_none) {
+        camera.processKeyboardInput((keyboard_input)key);
     }
+    return key;
 }
 
 // glfw: whenever the window size changed (by OS or user resize) this callback function executes
@@ -365,4 +689,11 @@ void framebuffer_size_callback(GLFWwindow* window, int width, int height) {
     // make sure the viewport matches the new window dimensions; note that width and
     // height will be significantly larger than specified on retina displays.
     glViewport(0, 0, width, height);
+    frameDirty = true;
+}
+
+// glfw: whenever the window contents are damaged (e.g. uncovered) and need to be redrawn
+// ---------------------------------------------------------------------------------------
+void window_refresh_callback(GLFWwindow* window) {
+    frameDirty = true;
 }
@@ -0,0 +1,275 @@
+#ifndef WORLD_H
+#define WORLD_H
+
+#include <includes/glm/glm.hpp>
+#include <terraingen.h>
+#include <arena.h>
+#include <chunk.h>
+#include <rlechunk.h>
+#include <region.h>
+#include <chunkcache.h>
+#include <mesher.h>
+#include <trace.h>
+
+#include <cmath>
+#include <unordered_map>
+#include <vector>
+
+// a generated chunk and the pooled mesh of its visible faces
+struct WorldChunk {
+    int cx;
+    int cz;
+    // the blocks in the format of the world, the other one is null
+    Chunk *blocks;
+    RleChunk *runs;
+    const ChunkMeshData *mesh;
+};
+
+// class to keep the chunks within view distance of the camera generated
+class World {
+private:
+    Terrain terrain;
+    // view distance in chunks around the chunk of the camera
+    int radius;
+    // a mesh and a bit for every neighbour that was loaded when it was built
+    struct ChunkMesh {
+        ChunkMeshData *data;
+        unsigned int neighbours;
+    };
+
+    // pool of per-chunk meshes, a mesh keeps the capacity of its vectors when reused
+    BufferPool<ChunkMeshData> buffers;
+    // mesh of every hot chunk, kept after the chunk leaves the view until the cache evicts it
+    std::unordered_map<ChunkCache::Key, ChunkMesh, ChunkCache::KeyHash> meshes;
+    ChunkCache cache;
+    std::vector<WorldChunk> chunks;
+    // the loaded chunks by their coords, for finding the neighbours of a chunk
+    std::unordered_map<ChunkCache::Key, WorldChunk, ChunkCache::KeyHash> loaded;
+    int centerX = 0;
+    int centerZ = 0;
+    unsigned int version = 0;
+    // chunks fetched per update, 0 for all of them, and the chunks in view left for later updates
+    int loadBudget = 0;
+    size_t pending = 0;
+
+    static int toChunk(float pos) {
+        return (int)std::floor(pos / Terrain::CHUNK_SIZE);
+    }
+
+    bool inRange(int cx, int cz) {
+        return std::abs(cx - centerX) <= radius && std::abs(cz - centerZ) <= radius;
+    }
+
+    bool isLoaded(int cx, int cz) {
+        return loaded.count(ChunkCache::Key(cx, cz)) > 0;
+    }
+
+    static const Chunk *storage(const WorldChunk &chunk, const Chunk*) {
+        return chunk.blocks;
+    }
+
+    static const RleChunk *storage(const WorldChunk &chunk, const RleChunk*) {
+        return chunk.runs;
+    }
+
+    // fills around with the loaded chunks next to the one at cx, cz
+    // @return a bit for every neighbour that is loaded
+    template <typename ChunkT>
+    unsigned int findNeighbours(int cx, int cz, Neighbourhood<ChunkT> &around) {
+        unsigned int neighbours = 0;
+        for (int dz = -1; dz <= 1; dz++) {
+            for (int dx = -1; dx <= 1; dx++) {
+                if (dx == 0 && dz == 0) {
+                    continue;
+                }
+                std::unordered_map<ChunkCache::Key, WorldChunk, ChunkCache::KeyHash>::iterator it = loaded.find(ChunkCache::Key(cx + dx, cz + dz));
+                if (it != loaded.end()) {
+                    around.chunks[dz + 1][dx + 1] = storage(it->second, around.chunks[1][1]);
+                    neighbours |= 1u << ((dz + 1) * 3 + dx + 1);
+                }
+            }
+        }
+        return neighbours;
+    }
+
+    // meshes a chunk with its loaded neighbours from its blocks or straight from its runs, unless
+    // its mesh was built with the same neighbours
+    template <typename ChunkT>
+    void meshChunk(WorldChunk &chunk, const ChunkT &blocks) {
+        Neighbourhood<ChunkT> around(blocks);
+        unsigned int neighbours = findNeighbours(chunk.cx, chunk.cz, around);
+        std::unordered_map<ChunkCache::Key, ChunkMesh, ChunkCache::KeyHash>::iterator it = meshes.find(ChunkCache::Key(chunk.cx, chunk.cz));
+        if (it != meshes.end() && it->second.neighbours == neighbours) {
+            chunk.mesh = it->second.data;
+            return;
+        }
+        TraceScope meshScope("mesh chunk", "cx", chunk.cx, "cz", chunk.cz);
+        if (it == meshes.end()) {
+            ChunkMesh mesh = { buffers.acquire(), 0 };
+            it = meshes.insert(std::make_pair(ChunkCache::Key(chunk.cx, chunk.cz), mesh)).first;
+        }
+        ChunkMesher::build(around, chunk.cx, chunk.cz, *it->second.data);
+        it->second.neighbours = neighbours;
+        cache.attach(chunk.cx, chunk.cz, it->second.data->memoryUsage());
+        chunk.mesh = it->second.data;
+    }
+
+    // releases the mesh of a chunk the cache moved out of the hot tier
+    void evictMesh(int cx, int cz) {
+        std::unordered_map<ChunkCache::Key, ChunkMesh, ChunkCache::KeyHash>::iterator it = meshes.find(ChunkCache::Key(cx, cz));
+        if (it != meshes.end()) {
+            buffers.release(it->second.data);
+            meshes.erase(it);
+        }
+    }
+
+public:
+    static const size_t DEFAULT_HOT_BUDGET = 32 << 20;
+    static const size_t DEFAULT_WARM_BUDGET = 16 << 20;
+
+    // @param terrain the generator, its width rounded to whole chunks is used as the view distance
+    // @param store where chunks are persisted, chunks are only generated from terrain if missing
+    // @param hotBudget bytes of chunks and their meshes kept after they leave the view
+    // @param warmBudget bytes of compressed chunks kept in memory before they go to store
+    // @param format how the loaded chunks are kept, chunk_runs meshes them from their runs
+    World(const Terrain &terrain, RegionStore *store = nullptr,
+            size_t hotBudget = DEFAULT_HOT_BUDGET, size_t warmBudget = DEFAULT_WARM_BUDGET,
+            chunk_format format = chunk_sections)
+        :terrain(terrain), buffers(1), cache(this->terrain, store, hotBudget, warmBudget, nullptr, format) {
+        int halfWidth = this->terrain.getWidth() / 2;
+        radius = (halfWidth + Terrain::CHUNK_SIZE / 2) / Terrain::CHUNK_SIZE;
+        chunks.reserve((2 * radius + 1) * (2 * radius + 1));
+        loaded.reserve(chunks.capacity());
+        cache.setEvictListener([this](int cx, int cz) {
+            evictMesh(cx, cz);
+        });
+    }
+
+    World(const World&) = delete;
+    World &operator=(const World&) = delete;
+
+    // returns the change counter of the set of loaded chunks
+    unsigned int getVersion() {
+        return version;
+    }
+
+    const std::vector<WorldChunk> &getChunks() {
+        return chunks;
+    }
+
+    // returns the number of chunks in view at once
+    size_t maxChunks() {
+        return chunks.capacity();
+    }
+
+    // limits the chunks fetched by a single update, the rest are fetched by the following ones
+    // so crossing into new terrain spreads over frames. 0 fetches every chunk in view at once
+    void setLoadBudget(int chunks) {
+        loadBudget = chunks;
+    }
+
+    // returns the number of chunks in view still waiting for an update to fetch them
+    size_t getPending() {
+        return pending;
+    }
+
+    // drops the chunks that left the view distance and fetches the ones that entered it from the cache
+    // @return true if the set of loaded chunks changed
+    bool update(glm::vec3 worldPos) {
+        int cx = toChunk(worldPos.x);
+        int cz = toChunk(worldPos.z);
+        if (version != 0 && cx == centerX && cz == centerZ && pending == 0) {
+            return false;
+        }
+        centerX = cx;
+        centerZ = cz;
+        TraceScope scope("world update", "cx", cx, "cz", cz);
+
+        for (size_t i = 0; i < chunks.size();) {
+            if (inRange(chunks[i].cx, chunks[i].cz)) {
+                ++i;
+                continue;
+            }
+            cache.release(chunks[i].cx, chunks[i].cz);
+            loaded.erase(ChunkCache::Key(chunks[i].cx, chunks[i].cz));
+            chunks[i] = chunks.back();
+            chunks.pop_back();
+        }
+
+        // nearest chunks first, so with a load budget the view fills in from the camera outwards
+        int fetched = 0;
+        pending = 0;
+        for (int r = 0; r <= radius; ++r) {
+            for (int z = cz - r; z <= cz + r; ++z) {
+                // whole rows at the top and bottom of the ring, only its two ends in between
+                int step = z == cz - r || z == cz + r ? 1 : 2 * r;
+                for (int x = cx - r; x <= cx + r; x += step) {
+                    if (isLoaded(x, z)) {
+                        continue;
+                    }
+                    if (loadBudget > 0 && fetched >= loadBudget) {
+                        ++pending;
+                        continue;
+                    }
+                    ++fetched;
+                    WorldChunk chunk;
+                    chunk.cx = x;
+                    chunk.cz = z;
+                    if (cache.getFormat() == chunk_runs) {
+                        chunk.blocks = nullptr;
+                        chunk.runs = cache.acquireRuns(x, z);
+                    } else {
+                        chunk.blocks = cache.acquire(x, z);
+                        chunk.runs = nullptr;
+                    }
+                    chunk.mesh = nullptr;
+                    chunks.push_back(chunk);
+                    loaded[ChunkCache::Key(x, z)] = chunk;
+                }
+            }
+        }
+
+        // mesh the new chunks, and again the ones whose neighbours came or went, so the faces at
+        // their sides and the ambient occlusion there match what is around them now
+        for (size_t i = 0; i < chunks.size(); i++) {
+            if (chunks[i].runs != nullptr) {
+                meshChunk(chunks[i], *chunks[i].runs);
+            } else {
+                meshChunk(chunks[i], *chunks[i].blocks);
+            }
+        }
+        // the meshes attached above may have put the hot tier over budget
+        cache.trim();
+        ++version;
+        return true;
+    }
+
+    // returns the number of chunks generated from noise and loaded from disk so far
+    unsigned int getChunksGenerated() {
+        return cache.getStats().generated;
+    }
+
+    unsigned int getChunksLoaded() {
+        return cache.getStats().diskLoads;
+    }
+
+    ChunkCache &getCache() {
+        return cache;
+    }
+
+    // allocation counter of the meshes, stops growing once the hot tier is full
+    const AllocStats &getBufferStats() {
+        return buffers.getStats();
+    }
+
+    // returns the bytes used by the block storage of the loaded chunks
+    size_t chunkMemory() {
+        size_t bytes = 0;
+        for (size_t i = 0; i < chunks.size(); i++) {
+            bytes += chunks[i].runs != nullptr ? chunks[i].runs->memoryUsage() : chunks[i].blocks->memoryUsage();
+        }
+        return bytes;
+    }
+};
+
+#endif
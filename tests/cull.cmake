@@ -0,0 +1,50 @@
+# renders the same frame with and without back-face culling and checks that culling leaves every
+# pixel as it is while submitting fewer triangles
+# cmake -DTERRAIN=path/to/terrain [-DWIDTH=n] [-DSEED=n] [-DFRAMES=n] -P cull.cmake
+if(NOT TERRAIN)
+    message(FATAL_ERROR "TERRAIN must be the path of the viewer")
+endif()
+if(NOT WIDTH)
+    set(WIDTH 64)
+endif()
+if(NOT SEED)
+    set(SEED 7)
+endif()
+if(NOT FRAMES)
+    set(FRAMES 2)
+endif()
+
+# --headless still opens a hidden window, which an X11 or Wayland session has to host. the test
+# reports itself skipped instead of failing on machines without one, e.g. CI (see SKIP_REGULAR_EXPRESSION)
+if(CMAKE_HOST_UNIX AND NOT CMAKE_HOST_APPLE AND "$ENV{DISPLAY}" STREQUAL "" AND "$ENV{WAYLAND_DISPLAY}" STREQUAL "")
+    message(STATUS "cull test skipped: no display, run it as xvfb-run ctest")
+    return()
+endif()
+
+# runs a headless render with the given flags, sets <prefix>_HASH and <prefix>_TRIANGLES
+function(render prefix)
+    execute_process(COMMAND "${TERRAIN}" --headless --frames ${FRAMES} ${ARGN} ${WIDTH} ${SEED}
+        OUTPUT_VARIABLE output ERROR_VARIABLE output RESULT_VARIABLE result)
+    if(NOT result EQUAL 0)
+        message(FATAL_ERROR "terrain ${ARGN} failed with ${result}:\n${output}")
+    endif()
+    if(NOT output MATCHES "hash ([0-9a-f]+)")
+        message(FATAL_ERROR "no frame hash in the output of terrain ${ARGN}:\n${output}")
+    endif()
+    set(${prefix}_HASH ${CMAKE_MATCH_1} PARENT_SCOPE)
+    if(NOT output MATCHES "per frame: ([0-9]+) triangles")
+        message(FATAL_ERROR "no triangle count in the output of terrain ${ARGN}:\n${output}")
+    endif()
+    set(${prefix}_TRIANGLES ${CMAKE_MATCH_1} PARENT_SCOPE)
+endfunction()
+
+render(CULLED)
+render(ALL --no-cull)
+message(STATUS "culled: hash ${CULLED_HASH}, ${CULLED_TRIANGLES} triangles")
+message(STATUS "not culled: hash ${ALL_HASH}, ${ALL_TRIANGLES} triangles")
+if(NOT CULLED_HASH STREQUAL ALL_HASH)
+    message(FATAL_ERROR "culling changed the frame, faces are missing or wound the wrong way")
+endif()
+if(NOT CULLED_TRIANGLES LESS ALL_TRIANGLES)
+    message(FATAL_ERROR "culling submitted ${CULLED_TRIANGLES} triangles, not fewer than ${ALL_TRIANGLES}")
+endif()